@@ -0,0 +1,172 @@
+/*
+ * Node arena: fixed-size objects carved out of a single huge-page backed
+ * mapping and addressed by 32-bit indices instead of pointers.
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "atomics.h"
+
+/* maximum number of objects in an arena. The mapping is only reserved
+ * up-front, memory is committed as objects get allocated.
+ */
+#ifndef ARENA_CAPACITY
+#define ARENA_CAPACITY (1U << 27)
+#endif
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+typedef struct arena {
+    char *base;        /* start of the mapping */
+    size_t length;     /* length of the mapping */
+    size_t obj_size;   /* size of the objects */
+    uint32_t capacity; /* maximum number of objects */
+    uint32_t next;     /* first index never handed out */
+    uint64_t free;     /* stack of freed indices, tagged against ABA */
+    uint32_t n_free;   /* number of objects in the free stack */
+} arena_t;
+
+/* Map the arena. Explicit huge pages (MAP_HUGETLB) are used when built with
+ * ARENA_HUGETLB and enough of them are reserved; otherwise transparent huge
+ * pages are requested for a regular mapping. An arena smaller than a huge page
+ * is kept on regular pages, lest its first object commit a whole huge page.
+ */
+static inline void arena_init(arena_t *a, size_t obj_size, uint32_t capacity)
+{
+    bool huge = obj_size * capacity >= HUGE_PAGE_SIZE;
+    size_t page = huge ? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+    a->obj_size = obj_size;
+    a->capacity = capacity;
+    a->length = (obj_size * capacity + page - 1) & ~(page - 1);
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *base = MAP_FAILED;
+#if defined(ARENA_HUGETLB) && defined(MAP_HUGETLB)
+    if (huge)
+        base = mmap(NULL, a->length, PROT_READ | PROT_WRITE,
+                    flags | MAP_HUGETLB, -1, 0);
+#endif
+    if (base == MAP_FAILED) {
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+        base = mmap(NULL, a->length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+        madvise(base, a->length, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+    }
+    a->base = base;
+
+    /* index 0 is reserved as the null reference */
+    a->next = 1;
+    a->free = 0;
+    a->n_free = 0;
+}
+
+static inline void arena_destroy(arena_t *a)
+{
+    munmap(a->base, a->length);
+}
+
+static inline void *arena_get(arena_t *a, uint32_t idx)
+{
+    return a->base + (size_t) idx * a->obj_size;
+}
+
+/* The low half of the free stack head is the index on top of the stack, the
+ * high half a tag bumped at each pop. A freed object holds the index of the
+ * one below it in its first 4 bytes.
+ */
+static inline uint32_t arena_alloc(arena_t *a)
+{
+    uint64_t head = __atomic_load_n(&a->free, __ATOMIC_ACQUIRE);
+    while ((uint32_t) head) {
+        uint32_t idx = (uint32_t) head;
+        uint32_t below =
+            __atomic_load_n((uint32_t *) arena_get(a, idx), __ATOMIC_RELAXED);
+        uint64_t new_head = ((head >> 32) + 1) << 32 | below;
+        uint64_t old = CAS_U64(&a->free, head, new_head);
+        if (old == head) {
+            __atomic_fetch_sub(&a->n_free, 1, __ATOMIC_RELAXED);
+            return idx;
+        }
+        head = old;
+    }
+
+    uint32_t idx = __atomic_fetch_add(&a->next, 1, __ATOMIC_RELAXED);
+    if (idx >= a->capacity) {
+        fprintf(stderr,
+                "Error: node arena exhausted (%u objects), rebuild with a "
+                "larger ARENA_CAPACITY or use a smaller key range (-r)\n",
+                a->capacity);
+        exit(1);
+    }
+    return idx;
+}
+
+static inline void arena_free(arena_t *a, uint32_t idx)
+{
+    uint32_t *below = arena_get(a, idx);
+    uint64_t head = __atomic_load_n(&a->free, __ATOMIC_RELAXED);
+    while (1) {
+        __atomic_store_n(below, (uint32_t) head, __ATOMIC_RELAXED);
+        uint64_t new_head = (head & ~0xffffffffULL) | idx;
+        uint64_t old = CAS_U64(&a->free, head, new_head);
+        if (old == head) {
+            __atomic_fetch_add(&a->n_free, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        head = old;
+    }
+}
+
+/* number of objects handed out and not freed, the null index excluded */
+static inline uint32_t arena_used(arena_t *a)
+{
+    uint32_t next = __atomic_load_n(&a->next, __ATOMIC_RELAXED);
+    if (next > a->capacity)
+        next = a->capacity;
+    return next - 1 - __atomic_load_n(&a->n_free, __ATOMIC_RELAXED);
+}
+
+/* Memory committed to the objects ever handed out, the free ones included:
+ * the resident pages of the part of the mapping they span, up to the end of
+ * the huge page they end in for an arena backed by them, as touching it may
+ * have committed it whole. Rounded up to that page if mincore fails.
+ */
+static inline size_t arena_bytes(arena_t *a)
+{
+    uint32_t next = __atomic_load_n(&a->next, __ATOMIC_RELAXED);
+    size_t bytes = (size_t) (next < a->capacity ? next : a->capacity) *
+                   a->obj_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t gran = a->obj_size * a->capacity >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE
+                                                              : page;
+    uintptr_t end = ((uintptr_t) a->base + bytes + gran - 1) & ~(gran - 1);
+    size_t span = end - (uintptr_t) a->base;
+    if (span > a->length)
+        span = a->length;
+
+    unsigned char *vec = malloc(span / page + 1);
+    if (!vec || mincore(a->base, span, vec) != 0) {
+        free(vec);
+        return span;
+    }
+    size_t resident = 0;
+    for (size_t i = 0; i < span / page; i++)
+        resident += vec[i] & 1;
+    free(vec);
+    return resident * page;
+}
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,78 @@
+/*
+ * Contention management for CAS retry loops: randomized exponential backoff
+ * whose initial window adapts to the failure rate each thread observes.
+ */
+#ifndef _BACKOFF_H_
+#define _BACKOFF_H_
+
+#include <stdint.h>
+
+#include "random.h"
+
+/* bounds of the backoff window, in spin iterations */
+#ifndef BACKOFF_MIN
+#define BACKOFF_MIN 8
+#endif
+#ifndef BACKOFF_MAX
+#define BACKOFF_MAX 8192
+#endif
+
+typedef struct backoff {
+    uint32_t window; /* upper bound of the next delay */
+} backoff_t;
+
+#if defined(BACKOFF)
+/* failed CASes per operation of the thread, as a moving average in 1/16 */
+static __thread uint32_t backoff_rate;
+/* state of the delays of the thread, seeded on first use: threads that fail
+ * together must not draw the same delays
+ */
+static __thread uint32_t backoff_seed;
+
+static inline void cpu_relax(void)
+{
+#if defined(BACKOFF_PAUSE) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__("pause" ::: "memory");
+#elif defined(BACKOFF_PAUSE) && defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/* Start an operation; called once per operation, whose retries all share b.
+ * Each operation weighs 1/8 in the average, so a thread whose operations keep
+ * failing starts backing off from a wider window.
+ */
+static inline void backoff_init(backoff_t *b)
+{
+    backoff_rate -= backoff_rate >> 3;
+    uint32_t window = BACKOFF_MIN + ((BACKOFF_MIN * backoff_rate) >> 4);
+    b->window = window < BACKOFF_MAX ? window : BACKOFF_MAX;
+}
+
+/* wait after a failed CAS, then double the window */
+static inline void backoff_wait(backoff_t *b)
+{
+    backoff_rate += 16 >> 3;
+
+    /* xorshift32, spin for a random time in [window / 2, window) */
+    if (!backoff_seed)
+        backoff_seed = (uint32_t) (getticks() ^ (uintptr_t) &backoff_seed) | 1;
+    backoff_seed ^= backoff_seed << 13;
+    backoff_seed ^= backoff_seed >> 17;
+    backoff_seed ^= backoff_seed << 5;
+    uint32_t spins = b->window / 2 + backoff_seed % (b->window / 2);
+    for (uint32_t i = 0; i < spins; i++)
+        cpu_relax();
+
+    if (b->window < BACKOFF_MAX)
+        b->window *= 2;
+}
+#else
+/* contention management disabled: retry right away */
+static inline void backoff_init(backoff_t *b) {}
+static inline void backoff_wait(backoff_t *b) {}
+#endif
+
+#endif /* _BACKOFF_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Counting Bloom filter over the values of a list, which lets lookups of
+ * absent values return without walking the list.
+ * A value is counted before it is inserted and uncounted after it is removed,
+ * so at any time the counters cover all the values in the list: if one of the
+ * counters of a value is zero, the value is not in the list at that time.
+ */
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "list.h"
+
+/* number of counters of a filter, a power of 2 */
+#ifndef BLOOM_COUNTERS
+#define BLOOM_COUNTERS (1 << 16)
+#endif
+/* number of counters of each value */
+#define BLOOM_HASHES 3
+
+typedef struct bloom {
+    uint16_t *counters;
+} bloom_t;
+
+#if defined(BLOOM)
+static inline void bloom_init(bloom_t *b)
+{
+    b->counters = calloc(BLOOM_COUNTERS, sizeof(uint16_t));
+    if (!b->counters) {
+        perror("calloc");
+        exit(1);
+    }
+}
+
+static inline void bloom_destroy(bloom_t *b)
+{
+    free(b->counters);
+}
+
+static inline size_t bloom_bytes(bloom_t *b)
+{
+    return BLOOM_COUNTERS * sizeof(uint16_t);
+}
+
+/* the i-th counter of val, by double hashing */
+static inline uint16_t *bloom_counter(bloom_t *b, val_t val, int i)
+{
+    uint64_t h = (uint64_t) val * 0x9e3779b97f4a7c15ULL;
+    uint32_t h1 = h >> 32, h2 = (uint32_t) h | 1;
+    return &b->counters[(h1 + i * h2) & (BLOOM_COUNTERS - 1)];
+}
+
+static inline void bloom_add(bloom_t *b, val_t val)
+{
+    for (int i = 0; i < BLOOM_HASHES; i++)
+        __atomic_fetch_add(bloom_counter(b, val, i), 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void bloom_remove(bloom_t *b, val_t val)
+{
+    for (int i = 0; i < BLOOM_HASHES; i++)
+        __atomic_fetch_sub(bloom_counter(b, val, i), 1, __ATOMIC_SEQ_CST);
+}
+
+/* return false if val is definitely not in the list */
+static inline bool bloom_contains(bloom_t *b, val_t val)
+{
+    for (int i = 0; i < BLOOM_HASHES; i++)
+        if (!__atomic_load_n(bloom_counter(b, val, i), __ATOMIC_SEQ_CST))
+            return false;
+    return true;
+}
+#else
+/* filter disabled: every lookup walks the list */
+static inline void bloom_init(bloom_t *b) {}
+static inline void bloom_destroy(bloom_t *b) {}
+static inline size_t bloom_bytes(bloom_t *b)
+{
+    return 0;
+}
+static inline void bloom_add(bloom_t *b, val_t val) {}
+static inline void bloom_remove(bloom_t *b, val_t val) {}
+static inline bool bloom_contains(bloom_t *b, val_t val)
+{
+    return true;
+}
+#endif
+
+#endif /* _BLOOM_H_ */
@@ -0,0 +1,138 @@
+/*
+ * Elimination of opposite updates: an add and a remove of the same value that
+ * meet in a small exchange array both return true without touching the list.
+ * This is linearizable: taken back to back, in the order that matches the
+ * state of the list at the time they meet, the two updates both succeed and
+ * leave the list as it was.
+ */
+#ifndef _ELIMINATION_H_
+#define _ELIMINATION_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "list.h"
+
+/* number of slots of the exchange array, a power of 2 */
+#ifndef ELIM_SLOTS
+#define ELIM_SLOTS 64
+#endif
+/* iterations an offer waits for an opposite update */
+#ifndef ELIM_SPINS
+#define ELIM_SPINS 256
+#endif
+
+enum { ELIM_ADD, ELIM_REMOVE };
+
+/* The state of an offer is its sequence number followed by 2 bits: 0 once
+ * withdrawn, 1 while waiting, 2 once matched. A sequence number is never
+ * reused, so a matcher that read the value of a waiting offer can only match
+ * that very offer.
+ */
+#define ELIM_IDLE 0
+#define ELIM_WAITING 1
+#define ELIM_MATCHED 2
+
+typedef struct elim elim_t;
+
+typedef struct elim_offer {
+    uint64_t state;
+    elim_t *elim; /* exchange array the offer is made in */
+    val_t val;
+    int op;
+} elim_offer_t;
+
+struct elim {
+    elim_offer_t *slots[ELIM_SLOTS]; /* the last offer made in each slot */
+};
+
+static inline void elim_init(elim_t *e)
+{
+    for (int i = 0; i < ELIM_SLOTS; i++)
+        e->slots[i] = NULL;
+}
+
+#if defined(ELIMINATION)
+/* offers may be read by other threads at any time, so they are never freed */
+static __thread elim_offer_t *elim_mine;
+
+static inline elim_offer_t **elim_slot(elim_t *e, val_t val)
+{
+    return &e->slots[((uint64_t) val * 0x9e3779b97f4a7c15ULL) >> 32 &
+                     (ELIM_SLOTS - 1)];
+}
+
+/* Match the offer waiting in val's slot, if it is the opposite of op on val;
+ * otherwise, offer op and wait for a while for an opposite update.
+ * @return true if op was eliminated, and so succeeded
+ */
+static inline bool elim_exchange(elim_t *e, int op, val_t val)
+{
+    elim_offer_t **slot = elim_slot(e, val);
+    elim_offer_t *other = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (other && other != elim_mine) {
+        uint64_t state = __atomic_load_n(&other->state, __ATOMIC_ACQUIRE);
+        if ((state & 3) == ELIM_WAITING &&
+            __atomic_load_n(&other->elim, __ATOMIC_RELAXED) == e &&
+            __atomic_load_n(&other->op, __ATOMIC_RELAXED) != op &&
+            __atomic_load_n(&other->val, __ATOMIC_RELAXED) == val) {
+            uint64_t matched = (state & ~3ULL) | ELIM_MATCHED;
+            if (__atomic_compare_exchange_n(&other->state, &state, matched,
+                                            false, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED)) {
+                __atomic_compare_exchange_n(slot, &other, NULL, false,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED);
+                return true;
+            }
+            return false;
+        }
+        /* leave the slot to a live offer on another value */
+        if ((state & 3) == ELIM_WAITING)
+            return false;
+    }
+
+    elim_offer_t *mine = elim_mine;
+    if (!mine) {
+        mine = elim_mine = malloc(sizeof(elim_offer_t));
+        mine->state = ELIM_IDLE;
+    }
+    uint64_t waiting = ((mine->state & ~3ULL) + 4) | ELIM_WAITING;
+    __atomic_store_n(&mine->elim, e, __ATOMIC_RELAXED);
+    __atomic_store_n(&mine->val, val, __ATOMIC_RELAXED);
+    __atomic_store_n(&mine->op, op, __ATOMIC_RELAXED);
+    __atomic_store_n(&mine->state, waiting, __ATOMIC_RELEASE);
+
+    /* a matcher that read a former offer of ours may match this one, even
+     * before it is published
+     */
+    bool published = __atomic_compare_exchange_n(
+        slot, &other, mine, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    bool matched = false;
+    for (int i = 0; published && i < ELIM_SPINS && !matched; i++)
+        matched = __atomic_load_n(&mine->state, __ATOMIC_ACQUIRE) !=
+                  waiting;
+
+    /* withdraw, unless matched in the meantime */
+    uint64_t state = waiting;
+    if (!matched)
+        matched = !__atomic_compare_exchange_n(&mine->state, &state,
+                                               waiting & ~3ULL, false,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE);
+    if (matched)
+        __atomic_store_n(&mine->state, waiting & ~3ULL, __ATOMIC_RELAXED);
+    if (published)
+        __atomic_compare_exchange_n(slot, &mine, NULL, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    return matched;
+}
+#else
+/* elimination disabled: updates always go to the list */
+static inline bool elim_exchange(elim_t *e, int op, val_t val)
+{
+    return false;
+}
+#endif
+
+#endif /* _ELIMINATION_H_ */
@@ -0,0 +1,76 @@
+/*
+ * Latency histogram with log-linear buckets: values below 16 are exact, and
+ * each further power of two is divided in 16 buckets, which bounds the
+ * relative error to 1/16.
+ */
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB_COUNT)
+
+typedef struct histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} histogram_t;
+
+static inline void hist_init(histogram_t *h)
+{
+    memset(h, 0, sizeof(histogram_t));
+}
+
+static inline int hist_index(uint64_t v)
+{
+    if (v < HIST_SUB_COUNT)
+        return v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + ((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+/* return the smallest value falling in bucket idx */
+static inline uint64_t hist_value(int idx)
+{
+    if (idx < HIST_SUB_COUNT)
+        return idx;
+    int shift = (idx >> HIST_SUB_BITS) - 1;
+    return (uint64_t) (HIST_SUB_COUNT | (idx & (HIST_SUB_COUNT - 1))) << shift;
+}
+
+static inline void hist_add(histogram_t *h, uint64_t v)
+{
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    if (v > h->max)
+        h->max = v;
+}
+
+static inline void hist_merge(histogram_t *to, const histogram_t *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        to->buckets[i] += from->buckets[i];
+    to->count += from->count;
+    if (from->max > to->max)
+        to->max = from->max;
+}
+
+/* return the value below which lies the fraction p of the samples */
+static inline uint64_t hist_percentile(const histogram_t *h, double p)
+{
+    uint64_t rank = (uint64_t) (p * h->count), seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            /* report the upper end of the bucket, capped by the maximum */
+            uint64_t v = hist_value(i + 1) - 1;
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif /* _HISTOGRAM_H_ */
@@ -0,0 +1,104 @@
+/*
+ * On-disk image of a list: a header followed by the values of the list in
+ * ascending order.
+ */
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "list.h"
+
+#define IMAGE_MAGIC "LLIMAGE1"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+typedef struct image_header {
+    char magic[8];
+    uint64_t size; /* number of values */
+} image_header_t;
+
+/* Write the size values in vals to path. The image is written aside and
+ * renamed, so that path never holds a partial image.
+ * @return true if succeed
+ */
+static inline bool image_write(const char *path, const val_t *vals,
+                               uint64_t size)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+        return false;
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+        return false;
+
+    image_header_t header;
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.size = size;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(vals, sizeof(val_t), size, f) == size;
+    ok = (fclose(f) == 0) && ok;
+    if (ok)
+        ok = rename(tmp, path) == 0;
+    if (!ok)
+        unlink(tmp);
+    return ok;
+}
+
+/* Map the image stored in path and check it holds at most max_size strictly
+ * ascending values, all of them between the values of the sentinels of the
+ * lock-free list, INT_MIN and INT_MAX.
+ * @return the values, or NULL if the image is not valid
+ */
+static inline const val_t *image_map(const char *path, uint64_t max_size,
+                                     uint64_t *size, size_t *length)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(image_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+    image_header_t *header =
+        mmap(NULL, *length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+        return NULL;
+    madvise(header, *length, MADV_SEQUENTIAL);
+
+    *size = header->size;
+    const val_t *vals = (const val_t *) (header + 1);
+    bool ok = memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) == 0 &&
+              *size == (*length - sizeof(image_header_t)) / sizeof(val_t) &&
+              *length == sizeof(image_header_t) + *size * sizeof(val_t) &&
+              *size <= max_size;
+    for (uint64_t i = 1; ok && i < *size; i++)
+        ok = vals[i - 1] < vals[i];
+    if (ok && *size > 0)
+        ok = vals[0] > INT_MIN && vals[*size - 1] < INT_MAX;
+    if (!ok) {
+        munmap(header, *length);
+        return NULL;
+    }
+    return vals;
+}
+
+static inline void image_unmap(const val_t *vals, size_t length)
+{
+    munmap((image_header_t *) vals - 1, length);
+}
+
+#endif /* _IMAGE_H_ */
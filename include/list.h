@@ -10,6 +10,26 @@ typedef intptr_t val_t;
 
 typedef struct node node_t;
 typedef struct list list_t;
+typedef struct list_iter list_iter_t;
+
+/* number of nodes the calling thread has traversed, maintained when the list
+ * is built with LIST_STATS
+ */
+#if defined(LIST_STATS)
+extern __thread unsigned long list_visited;
+#define LIST_VISIT() (list_visited++)
+#else
+#define LIST_VISIT() \
+    do {             \
+    } while (0)
+#endif
+
+/* number of lookups of the calling thread answered by the filter of the list,
+ * which is maintained when the list is built with BLOOM
+ */
+#if defined(BLOOM)
+extern __thread unsigned long list_filtered;
+#endif
 
 /* return 0 if not found, positive number otherwise */
 list_t *list_new();
@@ -27,7 +47,55 @@ bool list_add(list_t *the_list, val_t val);
  */
 bool list_remove(list_t *the_list, val_t val);
 
+/* remove the smallest value of the list and store it into val.
+ * @return false if the list is empty
+ */
+bool list_pop_min(list_t *the_list, val_t *val);
+
+/* remove one of the width smallest values of the list, picked at random, and
+ * store it into val; concurrent callers thus spread over the head of the list
+ * instead of all contending for its first node.
+ * @param skipped if not NULL, receives the rank error: the number of smaller
+ *        values left in the list once val is popped
+ * @return false if the list is empty
+ */
+bool list_pop_spray(list_t *the_list, int width, val_t *val, int *skipped);
+
 void list_delete(list_t *the_list);
+
+/* return the exact number of elements, linearizable with concurrent updates */
 int list_size(list_t *the_list);
 
+/* take a linearizable snapshot of the list while updates keep running.
+ * @return an iterator over the values of the snapshot in ascending order
+ */
+list_iter_t *list_iter_new(list_t *the_list);
+
+/* fetch the next value of the snapshot into val.
+ * @return false once the snapshot is exhausted
+ */
+bool list_iter_next(list_iter_t *it, val_t *val);
+
+void list_iter_delete(list_iter_t *it);
+
+typedef struct list_mem {
+    size_t live;    /* nodes linked in the list, the sentinels included */
+    size_t retired; /* nodes unlinked from the list, not reclaimed yet */
+    size_t free;    /* reclaimed nodes, kept for reuse */
+    size_t bytes;   /* memory of all those nodes and of the list itself */
+} list_mem_t;
+
+/* account the memory used by the list; exact when no update is in progress */
+void list_mem(list_t *the_list, list_mem_t *mem);
+
+/* write a snapshot of the list to the file path, as a sorted binary image.
+ * @return true if succeed
+ */
+bool list_save(list_t *the_list, const char *path);
+
+/* create a new list holding the values of the image saved in path.
+ * @return NULL if the image cannot be read
+ */
+list_t *list_load(const char *path);
+
 #endif
@@ -10,6 +10,7 @@ typedef uint32_t ptlock_t;
 #define INIT_LOCK(lock) lock_init(lock)
 #define DESTROY_LOCK(lock) lock_destroy(lock)
 #define LOCK(lock) lock_lock(lock)
+#define TRYLOCK(lock) lock_trylock(lock)
 #define UNLOCK(lock) lock_unlock(lock)
 
 static inline void lock_init(volatile ptlock_t *l)
@@ -29,6 +30,12 @@ static inline uint32_t lock_lock(volatile ptlock_t *l)
     return 0;
 }
 
+/* return true if the lock was free, and is now taken */
+static inline bool lock_trylock(volatile ptlock_t *l)
+{
+    return CAS_U32(l, (uint32_t) 0, (uint32_t) 1) == 0;
+}
+
 static inline uint32_t lock_unlock(volatile ptlock_t *l)
 {
     *l = (uint32_t) 0;
@@ -40,6 +47,7 @@ static inline uint32_t lock_unlock(volatile ptlock_t *l)
 #define INIT_LOCK(lock)
 #define DESTROY_LOCK(lock)
 #define LOCK(lock)
+#define TRYLOCK(lock) true
 #define UNLOCK(lock)
 #endif
 
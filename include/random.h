@@ -53,6 +53,18 @@ static inline uint64_t *seed_rand()
     return _seeds;
 }
 
+/* Seed the state s of a generator private to the calling thread, for code
+ * that cannot rely on the seeds of the caller. The address of s tells apart
+ * threads seeding at the same time.
+ */
+static inline void seed_rand_thread(uint64_t s[3])
+{
+    uint64_t mix = getticks() ^ (uintptr_t) s;
+    s[0] = mix % 123456789 + 1;
+    s[1] = mix % 362436069 + 1;
+    s[2] = mix % 521288629 + 1;
+}
+
 /* Marsaglia's xorshf generator */
 static inline uint64_t xorshf96(uint64_t *x, uint64_t *y, uint64_t *z)
 {
@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+
+# Run the open loop mode of each program over a range of offered loads, to
+# locate the knee of its latency curve.
+# E.g., scripts/latency_sweep.sh "100000 200000 400000" out/test-lock out/test-lockfree -n4 -i1024
+
+rates=$1;
+shift;
+
+source scripts/lock_exec;
+
+progs="";
+while [ $# -gt 0 ] && [ "${1:0:1}" != "-" ];
+do
+    progs="$progs $1";
+    shift;
+done;
+params="$@";
+
+for prog in $progs
+do
+    printf "#       %s\n" "$prog";
+    echo "#rate      throughput  p50 (us)    p99 (us)    p99.9 (us)";
+
+    for rate in $rates
+    do
+	out=$(./$prog $params -R$rate);
+	thr=$(echo "$out" | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
+	lat=$(echo "$out" | grep "Latency");
+	p50=$(echo "$lat" | awk '{print $5}');
+	p99=$(echo "$lat" | awk '{print $7}');
+	p999=$(echo "$lat" | awk '{print $9}');
+	printf "%-11d%-12d%-12s%-12s%-12s\n" $rate $thr $p50 $p99 $p999;
+    done;
+done;
+
+source scripts/unlock_exec;
@@ -0,0 +1,187 @@
+#!/usr/bin/env bash
+
+# Compare the throughput and the p99 latency of each program on the workloads
+# of scripts/run_ll.sh against a stored baseline, and fail if any regressed.
+# Each workload is run several times, and a result is the median of the runs,
+# whose spread is estimated from their median absolute deviation, so that a
+# run stalled by the machine does not count. A result regresses if it is worse
+# than the baseline by more than K times the spread of the difference of two
+# results, estimated from the baseline alone lest a noisier check widen it, and
+# by more than a relative floor. A p99 whose spread exceeds MAX_NOISE % of its
+# median when the baseline is recorded cannot be gated: it is recorded as "-",
+# and not checked.
+# E.g., scripts/perfcheck.sh             check against scripts/perf_baseline.dat
+#       scripts/perfcheck.sh --update    record a new baseline
+
+update=0;
+if [ "$1" = "--update" ];
+then
+    update=1;
+    shift;
+fi;
+baseline=${1:-scripts/perf_baseline.dat};
+
+# settings
+progs="out/test-lock out/test-lockfree";
+initials="128 1024 8192";
+updates="0 10 50";
+duration=${PERF_DURATION:-300};
+reps=${PERF_REPS:-10};
+sigmas=${PERF_SIGMAS:-3};
+thr_floor=${PERF_THR_FLOOR:-10}; # % of the baseline throughput
+lat_floor=${PERF_LAT_FLOOR:-50}; # % of the baseline p99
+max_noise=${PERF_MAX_NOISE:-25}; # spread of a p99, % of its median
+
+if [ $reps -lt 5 ];
+then
+    echo "PERF_REPS must be at least 5 to estimate the spread of the runs";
+    exit 1;
+fi;
+
+source scripts/lock_exec;
+source scripts/config;
+
+# two threads, unless it would oversubscribe the machine
+[ $max_cores -gt 1 ] && threads=${PERF_THREADS:-2} || threads=${PERF_THREADS:-1};
+
+# the lists are filled once, and loaded by each run
+img_dir="out/perf";
+mkdir -p $img_dir;
+for initial in $initials
+do
+    out/test-lockfree -n1 -d1 -u0 -i$initial -r$((2*$initial)) \
+	--save $img_dir/ll.i$initial.img > /dev/null;
+done;
+
+# print the median of the values on stdin, and their spread: 1.4826 times
+# their median absolute deviation, which is the standard deviation of normally
+# distributed values
+stats()
+{
+    awk 'function median(a, n,    i, j, t) {
+	     for (i = 1; i < n; i++)
+		 for (j = i; j > 0 && a[j - 1] > a[j]; j--) {
+		     t = a[j]; a[j] = a[j - 1]; a[j - 1] = t;
+		 }
+	     return n % 2 ? a[(n - 1) / 2] : (a[n / 2 - 1] + a[n / 2]) / 2;
+	 }
+	 { v[n++] = $1 }
+	 END { m = median(v, n);
+	       for (i = 0; i < n; i++)
+		   d[i] = v[i] > m ? v[i] - m : m - v[i];
+	       printf "%.1f %.1f\n", m, 1.4826 * median(d, n) }';
+}
+
+# print the throughput of reps runs of prog
+measure_thr()
+{
+    prog=$1;
+    shift;
+    for r in $(seq $reps)
+    do
+	./$prog "$@" | grep "#txs" | cut -d'(' -f2 | cut -d. -f1;
+    done;
+}
+
+# print the p99 latency (us) of reps runs of prog in open loop at rate
+measure_p99()
+{
+    prog=$1;
+    rate=$2;
+    shift 2;
+    for r in $(seq $reps)
+    do
+	./$prog "$@" -R$rate | grep "Latency" | awk '{print $7}';
+    done;
+}
+
+if [ $update -eq 1 ];
+then
+    {
+	echo "# perfcheck baseline, $(uname -n), $(date +%F)";
+	echo "#prog                initial update threads thr     thr_sd  rate    p99     p99_sd";
+	for prog in $progs
+	do
+	    for initial in $initials
+	    do
+		for u in $updates
+		do
+		    params="-n$threads -d$duration -r$((2*$initial)) -u$u --load $img_dir/ll.i$initial.img";
+		    # first find the throughput, the latency is measured at half of it
+		    read thr thr_sd < <(measure_thr $prog $params | stats);
+		    rate=$(awk -v t=$thr 'BEGIN { printf "%d", t / 2 }');
+		    read p99 p99_sd < <(measure_p99 $prog $rate $params | stats);
+		    if awk -v m=$p99 -v s=$p99_sd -v mn=$max_noise \
+			   'BEGIN { exit !(s > mn / 100 * m) }';
+		    then
+			echo "$prog $initial $u: p99 $p99 +- $p99_sd us is too noisy to gate" >&2;
+			p99="-";
+			p99_sd="-";
+		    fi;
+		    printf "%-21s%-8d%-7d%-8d%-8.0f%-8.0f%-8d%-8s%-8s\n" \
+			$prog $initial $u $threads $thr $thr_sd $rate $p99 $p99_sd;
+		done;
+	    done;
+	done;
+    } | tee $baseline;
+    source scripts/unlock_exec;
+    exit 0;
+fi;
+
+if [ ! -f "$baseline" ];
+then
+    echo "No baseline $baseline, record one with: $0 --update";
+    source scripts/unlock_exec;
+    exit 1;
+fi;
+
+echo "#prog                initial update throughput (base -> now, tol)        p99 us (base -> now, tol)";
+failed=0;
+ungated=0;
+while read prog initial u n thr_b thr_sd_b rate p99_b p99_sd_b
+do
+    [ "${prog:0:1}" = "#" ] && continue;
+
+    params="-n$n -d$duration -r$((2*$initial)) -u$u --load $img_dir/ll.i$initial.img";
+    read thr thr_sd < <(measure_thr $prog $params | stats);
+    if [ "$p99_b" = "-" ];
+    then
+	p99=0;
+	ungated=$(($ungated + 1));
+    else
+	read p99 p99_sd < <(measure_p99 $prog $rate $params | stats);
+    fi;
+
+    report=$(awk -v k=$sigmas -v tf=$thr_floor -v lf=$lat_floor \
+		 -v tb=$thr_b -v tsb=$thr_sd_b -v t=$thr \
+		 -v lb=$p99_b -v lsb=$p99_sd_b -v l=$p99 '
+	function max(a, b) { return a > b ? a : b }
+	BEGIN {
+	    ttol = max(k * sqrt(2) * tsb, tf / 100 * tb);
+	    tbad = t < tb - ttol;
+	    printf "%-9d-> %-9d%-8s%-8s", tb, t,
+		sprintf("%.0f%%", 100 * ttol / tb), tbad ? "SLOWER" : "ok";
+	    if (lb == "-") {
+		printf "%-28snot gated %d\n", "-", tbad;
+		exit;
+	    }
+	    ltol = max(k * sqrt(2) * lsb, lf / 100 * lb);
+	    lbad = l > lb + ltol;
+	    printf "%-8.1f-> %-8.1f%-8s%-8s%d\n", lb, l,
+		sprintf("%.0f%%", 100 * ltol / lb), lbad ? "SLOWER" : "ok",
+		tbad || lbad
+	}');
+    printf "%-21s%-8d%-7d%s\n" $prog $initial $u "${report% *}";
+    [ "${report##* }" = "1" ] && failed=$(($failed + 1));
+done < $baseline;
+
+source scripts/unlock_exec;
+
+[ $ungated -ne 0 ] &&
+    echo "$ungated p99 latencies were too noisy to gate when $baseline was recorded";
+if [ $failed -ne 0 ];
+then
+    echo "$failed workload(s) regressed against $baseline";
+    exit 1;
+fi;
+echo "No regression against $baseline";
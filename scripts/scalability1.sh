@@ -10,29 +10,15 @@ prog=$1;
 shift;
 params="$@";
 
-echo "#cores  throughput  %linear scalability"
-
-printf "%-8d" 1;
-thr1=$(./$prog $params -n1 | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-printf "%-12d" $thr1;
-printf "%-8.2f" 100.00;
-printf "%-8d\n" 1;
-
+# all the thread counts are measured by a single process, on the same list
+sweep=1;
 for c in $cores
 do
-    if [ $c -eq 1 ]
-    then
-	continue;
-    fi;
+    [ $c -eq 1 ] || sweep="$sweep,$c";
+done;
 
-    printf "%-8d" $c;
-    thr=$(./$prog $params -n$c | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-    printf "%-12d" $thr;
-    scl=$(echo "$thr/$thr1" | bc -l);
-    linear_p=$(echo "100*(1-(($c-$scl)/$c))" | bc -l);
-    printf "%-8.2f" $linear_p;
-    printf "%-8.2f\n" $scl;
+echo "#cores  throughput  %linear scalability"
 
-done;
+./$prog $params --sweep=$sweep | grep -v "^#";
 
 source scripts/unlock_exec;
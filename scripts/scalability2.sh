@@ -12,54 +12,25 @@ prog2=$1;
 shift;
 params="$@";
 
-printf "#       %-32s%-32s\n" "$prog1" "$prog2";
-echo "#cores  throughput  %linear scalability throughput  %linear scalability";
-
-prog=$prog1;
-
-printf "%-8d" 1;
-thr1a=$(./$prog $params -n1 | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-printf "%-12d" $thr1a;
-printf "%-8.2f" 100.00;
-printf "%-12d" 1;
-
-prog=$prog2;
-
-thr1b=$(./$prog $params -n1 | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-printf "%-12d" $thr1b;
-printf "%-8.2f" 100.00;
-printf "%-8d\n" 1;
-
+# all the thread counts are measured by a single process, on the same list
+sweep=1;
 for c in $cores
 do
-    if [ $c -eq 1 ]
-    then
-	continue;
-    fi;
-
-    printf "%-8d" $c;
-
-    prog=$prog1;
-    thr1=$thr1a;
-
-    thr=$(./$prog $params -n$c | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-    printf "%-12d" $thr;
-    scl=$(echo "$thr/$thr1" | bc -l);
-    linear_p=$(echo "100*(1-(($c-$scl)/$c))" | bc -l);
-    printf "%-8.2f" $linear_p;
-    printf "%-12.2f" $scl;
-
-    prog=$prog2;
-    thr1=$thr1b;
+    [ $c -eq 1 ] || sweep="$sweep,$c";
+done;
 
-    thr=$(./$prog $params -n$c | grep "#txs" | cut -d'(' -f2 | cut -d. -f1);
-    printf "%-12d" $thr;
-    scl=$(echo "$thr/$thr1" | bc -l);
-    linear_p=$(echo "100*(1-(($c-$scl)/$c))" | bc -l);
-    printf "%-8.2f" $linear_p;
-    printf "%-8.2f\n" $scl;
+printf "#       %-32s%-32s\n" "$prog1" "$prog2";
+echo "#cores  throughput  %linear scalability throughput  %linear scalability";
 
+mapfile -t rows1 < <(./$prog1 $params --sweep=$sweep | grep -v "^#");
+mapfile -t rows2 < <(./$prog2 $params --sweep=$sweep | grep -v "^#");
 
+for i in "${!rows1[@]}"
+do
+    read c thr1 linear_p1 scl1 <<< "${rows1[$i]}";
+    read c thr2 linear_p2 scl2 <<< "${rows2[$i]}";
+    printf "%-8d%-12d%-8.2f%-12.2f%-12d%-8.2f%-8.2f\n" \
+        $c $thr1 $linear_p1 $scl1 $thr2 $linear_p2 $scl2;
 done;
 
 source scripts/unlock_exec;
@@ -3,12 +3,28 @@
 source scripts/lock_exec;
 source scripts/config;
 
+img=$(mktemp);
+failed=0;
 for bin in $(ls out/test-*);
 do
     echo "Testing: $bin";
     $bin -n$max_cores | grep -i "expected";
     $bin -n$max_cores -i32 -r64 | grep -i "expected";
     $bin -n$max_cores -i16 -r32 -u100 | grep -i "expected";
+    # with a thread taking snapshots during the updates
+    $bin -n$max_cores -u50 -s1 | grep -i "expected";
+    # save a list, then load it back with no updates: the sizes must match
+    saved=$($bin -n$max_cores --save $img | grep -i "expected");
+    loaded=$($bin -n$max_cores -u0 --load $img | grep -i "expected");
+    echo "$saved (saved)";
+    echo "$loaded (loaded)";
+    if [ "${saved##* }" != "${loaded##* }" ];
+    then
+	echo "Error: $bin loaded ${loaded##* } values out of ${saved##* }";
+	failed=1;
+    fi;
 done;
+rm -f $img;
 
 source scripts/unlock_exec;
+exit $failed;
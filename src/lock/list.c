@@ -1,58 +1,113 @@
+#include "arena.h"
+#include "bloom.h"
+#include "elimination.h"
+#include "image.h"
 #include "list.h"
 
+/* nodes live in the list's arena and link to each other by 32-bit index,
+ * so that a node and its lock fit in 16 bytes.
+ */
 struct node {
     val_t data;
-    struct node *next;
-    ptlock_t *lock; /* lock for this entry */
+    uint32_t next; /* arena index of the next node, 0 if none */
+    ptlock_t lock; /* lock for this entry */
 };
 
 struct list {
     node_t *head;
+    arena_t arena;
+    elim_t elim;   /* where opposite updates of a value cancel out */
+    bloom_t bloom; /* filter of the values, counted before their insertion */
 };
 
+static inline node_t *get_node(list_t *the_list, uint32_t idx)
+{
+    return idx ? arena_get(&the_list->arena, idx) : NULL;
+}
+
+static inline uint32_t get_idx(list_t *the_list, node_t *node)
+{
+    return node ? (uint32_t) (((char *) node - the_list->arena.base) /
+                              sizeof(node_t))
+                : 0;
+}
+
+/* return the successor of elem, NULL if elem is the last node */
+static inline node_t *next_node(list_t *the_list, node_t *elem)
+{
+    return get_node(the_list, elem->next);
+}
+
+static inline void free_node(list_t *the_list, node_t *node)
+{
+    arena_free(&the_list->arena, get_idx(the_list, node));
+}
+
+struct list_iter {
+    val_t *vals; /* values of the snapshot, in ascending order */
+    int size;
+    int pos;
+};
+
+#if defined(LIST_STATS)
+__thread unsigned long list_visited;
+#endif
+/* random state of the pops of each thread, seeded on first use */
+static __thread uint64_t spray_seeds[3];
+#if defined(BLOOM)
+__thread unsigned long list_filtered;
+#endif
+
 bool list_contains(list_t *the_list, val_t val)
 {
+    if (!bloom_contains(&the_list->bloom, val)) {
+#if defined(BLOOM)
+        list_filtered++;
+#endif
+        return false;
+    }
+
     /* lock sentinel node */
     node_t *elem = the_list->head;
-    LOCK(elem->lock);
+    LOCK(&elem->lock);
     if (!elem->next) { /* the list is empty */
-        UNLOCK(elem->lock);
+        UNLOCK(&elem->lock);
         return false;
     }
 
     node_t *prev = elem;
-    while (elem->next && elem->next->data <= val) {
-        if (elem->next->data == val) { /* found it */
-            UNLOCK(elem->lock);
+    while (elem->next && next_node(the_list, elem)->data <= val) {
+        if (next_node(the_list, elem)->data == val) { /* found it */
+            UNLOCK(&elem->lock);
             return true;
         }
         prev = elem;
-        elem = elem->next;
-        LOCK(elem->lock);
-        UNLOCK(prev->lock);
+        elem = next_node(the_list, elem);
+        LIST_VISIT();
+        LOCK(&elem->lock);
+        UNLOCK(&prev->lock);
     }
 
-    /* just check if the last node in the list is not equal to val */
-    if (elem->data == val) { /* found */
-        UNLOCK(elem->lock);
+    /* just check if the last node in the list is not equal to val; the
+     * sentinel holds no value
+     */
+    if (elem != the_list->head && elem->data == val) { /* found */
+        UNLOCK(&elem->lock);
         return true;
     }
 
     /* not found in the list */
-    UNLOCK(elem->lock);
+    UNLOCK(&elem->lock);
     return false;
 }
 
-static node_t *new_node(val_t val, node_t *next)
+static node_t *new_node(list_t *the_list, val_t val, uint32_t next)
 {
-    /* allocate node */
-    node_t *node = malloc(sizeof(node_t));
-
-    /* allocate lock */
-    node->lock = malloc(sizeof(ptlock_t));
+    /* allocate node, its lock included */
+    node_t *node = get_node(the_list, arena_alloc(&the_list->arena));
 
     /* initialize the lock */
-    INIT_LOCK(node->lock);
+    INIT_LOCK(&node->lock);
 
     node->data = val;
     node->next = next;
@@ -64,8 +119,13 @@ list_t *list_new()
     /* allocate list */
     list_t *the_list = malloc(sizeof(list_t));
 
+    /* reserve the address space of the nodes */
+    arena_init(&the_list->arena, sizeof(node_t), ARENA_CAPACITY);
+
     /* now need to create the sentinel node */
-    the_list->head = new_node(0, NULL);
+    the_list->head = new_node(the_list, 0, 0);
+    elim_init(&the_list->elim);
+    bloom_init(&the_list->bloom);
     return the_list;
 }
 
@@ -73,34 +133,16 @@ void list_delete(list_t *the_list)
 {
     /* must lock the whole list */
     node_t *elem = the_list->head;
-    LOCK(elem->lock);
-    if (!elem->next) { /* an empty list, just delete sentinel node */
-        UNLOCK(elem->lock);
-        DESTROY_LOCK(elem->lock);
-
-        /* deallocate memory and we are done */
-        free(elem->lock);
-        free(elem);
-    } else { /* have to go through list */
-        while (elem->next) {
-            /* lock everything */
-            LOCK(elem->next->lock);
-            elem = elem->next;
-        }
-
-        /* everything is locked, delete them */
-        while (the_list->head) {
-            elem = the_list->head;
-            the_list->head = elem->next;
-
-            UNLOCK(elem->lock);
-            DESTROY_LOCK(elem->lock);
-
-            free(elem->lock);
-            free(elem);
-        }
+    LOCK(&elem->lock);
+    while (elem->next) {
+        /* lock everything */
+        elem = next_node(the_list, elem);
+        LOCK(&elem->lock);
     }
 
+    /* everything is locked, the nodes all go away with the arena */
+    arena_destroy(&the_list->arena);
+    bloom_destroy(&the_list->bloom);
     free(the_list);
 }
 
@@ -109,66 +151,192 @@ int list_size(list_t *the_list)
     int size = 0;
     /* must lock the whole list */
     node_t *prev = the_list->head;
-    LOCK(prev->lock);
+    LOCK(&prev->lock);
     if (!prev->next) { /* the list is empty */
-        UNLOCK(prev->lock);
+        UNLOCK(&prev->lock);
         return size;
     }
 
-    node_t *elem = prev->next;
-    LOCK(elem->lock);
+    node_t *elem = next_node(the_list, prev);
+    LOCK(&elem->lock);
     size++;
     while (elem->next) {
         size++;
-        UNLOCK(prev->lock);
+        UNLOCK(&prev->lock);
         prev = elem;
-        elem = elem->next;
-        LOCK(elem->lock);
+        elem = next_node(the_list, elem);
+        LOCK(&elem->lock);
     }
 
     /* we did not find it; unlock and report failure */
-    UNLOCK(elem->lock);
-    UNLOCK(prev->lock);
+    UNLOCK(&elem->lock);
+    UNLOCK(&prev->lock);
     return size;
 }
 
+bool list_pop_min(list_t *the_list, val_t *val)
+{
+    return list_pop_spray(the_list, 1, val, NULL);
+}
+
+bool list_pop_spray(list_t *the_list, int width, val_t *val, int *skipped)
+{
+    uint64_t *s = spray_seeds;
+    if (!s[0])
+        seed_rand_thread(s);
+    int target = 0;
+    if (width > 1)
+        target = my_random(&s[0], &s[1], &s[2]) % width;
+
+    /* lock sentinel node */
+    node_t *prev = the_list->head;
+    LOCK(&prev->lock);
+    if (!prev->next) { /* the list is empty */
+        UNLOCK(&prev->lock);
+        return false;
+    }
+
+    /* Walk to the target-th node, or to the last one. Operations cannot
+     * overtake each other, so the nodes passed are exactly the smaller values
+     * in the list when elem is unlinked: their number is the rank error.
+     */
+    int rank = 0;
+    node_t *elem = next_node(the_list, prev);
+    LOCK(&elem->lock);
+    while (elem->next && rank < target) {
+        UNLOCK(&prev->lock);
+        prev = elem;
+        elem = next_node(the_list, elem);
+        LOCK(&elem->lock);
+        rank++;
+    }
+
+    /* assign prev next to elem next */
+    prev->next = elem->next;
+    *val = elem->data;
+    if (skipped)
+        *skipped = rank;
+
+    /* unlock and deallocate mem */
+    UNLOCK(&elem->lock);
+    DESTROY_LOCK(&elem->lock);
+    free_node(the_list, elem);
+    bloom_remove(&the_list->bloom, *val);
+
+    UNLOCK(&prev->lock);
+    return true;
+}
+
+/* Operations traverse the list hand-over-hand and thus can never overtake each
+ * other: walking the whole list that way observes exactly the updates that
+ * locked the sentinel before us, which makes the copy linearizable.
+ */
+list_iter_t *list_iter_new(list_t *the_list)
+{
+    list_iter_t *it = malloc(sizeof(list_iter_t));
+    int cap = 64;
+    it->vals = malloc(cap * sizeof(val_t));
+    it->size = 0;
+    it->pos = 0;
+
+    node_t *prev = the_list->head;
+    LOCK(&prev->lock);
+    while (prev->next) {
+        node_t *elem = next_node(the_list, prev);
+        LOCK(&elem->lock);
+        if (it->size == cap) {
+            cap *= 2;
+            it->vals = realloc(it->vals, cap * sizeof(val_t));
+        }
+        it->vals[it->size++] = elem->data;
+        UNLOCK(&prev->lock);
+        prev = elem;
+    }
+    UNLOCK(&prev->lock);
+    return it;
+}
+
+bool list_iter_next(list_iter_t *it, val_t *val)
+{
+    if (it->pos == it->size)
+        return false;
+    *val = it->vals[it->pos++];
+    return true;
+}
+
+void list_iter_delete(list_iter_t *it)
+{
+    free(it->vals);
+    free(it);
+}
+
+void list_mem(list_t *the_list, list_mem_t *mem)
+{
+    /* removed nodes go back to the arena right away */
+    mem->live = arena_used(&the_list->arena);
+    mem->retired = 0;
+    mem->free = __atomic_load_n(&the_list->arena.n_free, __ATOMIC_RELAXED);
+    mem->bytes = sizeof(list_t) + arena_bytes(&the_list->arena) +
+                 bloom_bytes(&the_list->bloom);
+}
+
+/* Lock the sentinel node for an update op of val. While it is taken, look
+ * for an opposite update of val to eliminate op with instead.
+ * @return false if op was eliminated, without locking the sentinel
+ */
+static bool lock_head(list_t *the_list, int op, val_t val)
+{
+    while (!TRYLOCK(&the_list->head->lock)) {
+        if (elim_exchange(&the_list->elim, op, val))
+            return false;
+    }
+    return true;
+}
+
 bool list_add(list_t *the_list, val_t val)
 {
     /* lock sentinel node */
     node_t *elem = the_list->head;
-    LOCK(elem->lock);
+    if (!lock_head(the_list, ELIM_ADD, val))
+        return true;
     if (!elem->next) { /* the list is empty */
-        node_t *new_elem = new_node(val, NULL);
-        elem->next = new_elem;
-        UNLOCK(elem->lock);
+        bloom_add(&the_list->bloom, val);
+        node_t *new_elem = new_node(the_list, val, 0);
+        elem->next = get_idx(the_list, new_elem);
+        UNLOCK(&elem->lock);
         return true;
     }
 
     node_t *prev = elem;
 
-    while (elem->next && elem->next->data <= val) {
-        if (elem->next->data == val) {
+    while (elem->next && next_node(the_list, elem)->data <= val) {
+        if (next_node(the_list, elem)->data == val) {
             /* we already have that value, unlock and report failure */
-            UNLOCK(elem->lock);
+            UNLOCK(&elem->lock);
             return false;
         }
         prev = elem;
-        elem = elem->next;
-        LOCK(elem->lock);
-        UNLOCK(prev->lock);
+        elem = next_node(the_list, elem);
+        LIST_VISIT();
+        LOCK(&elem->lock);
+        UNLOCK(&prev->lock);
     }
-    /* just check if the last node in the list is not equal to val */
-    if (elem->data == val) { /* if equal report failure */
-        UNLOCK(elem->lock);
+    /* just check if the last node in the list is not equal to val; the
+     * sentinel holds no value
+     */
+    if (elem != the_list->head && elem->data == val) {
+        /* if equal report failure */
+        UNLOCK(&elem->lock);
         return false;
     }
 
-    /* place it in between prev and elem */
-    node_t *new_elem = new_node(val, elem->next);
-    elem->next = new_elem;
+    /* place it in between prev and elem, once counted by the filter */
+    bloom_add(&the_list->bloom, val);
+    node_t *new_elem = new_node(the_list, val, elem->next);
+    elem->next = get_idx(the_list, new_elem);
 
     /* successfully added new value, unlock elem */
-    UNLOCK(elem->lock);
+    UNLOCK(&elem->lock);
     return true;
 }
 
@@ -176,33 +344,35 @@ bool list_remove(list_t *the_list, val_t val)
 {
     /* lock sentinel node */
     node_t *prev = the_list->head;
-    LOCK(prev->lock);
+    if (!lock_head(the_list, ELIM_REMOVE, val))
+        return true;
     if (!prev->next) { /* the list is empty */
-        UNLOCK(prev->lock);
+        UNLOCK(&prev->lock);
         return false;
     }
 
-    node_t *elem = prev->next;
-    LOCK(elem->lock);
+    node_t *elem = next_node(the_list, prev);
+    LOCK(&elem->lock);
     while (elem->next && elem->data <= val) {
         if (elem->data == val) {
             /* if found, assign prev next to elem next */
             prev->next = elem->next;
 
             /* unlock and deallocate mem */
-            UNLOCK(elem->lock);
-            DESTROY_LOCK(elem->lock);
-            free(elem->lock);
-            free(elem);
+            UNLOCK(&elem->lock);
+            DESTROY_LOCK(&elem->lock);
+            free_node(the_list, elem);
+            bloom_remove(&the_list->bloom, val);
 
             /* success */
-            UNLOCK(prev->lock);
+            UNLOCK(&prev->lock);
             return true;
         }
-        UNLOCK(prev->lock);
+        UNLOCK(&prev->lock);
         prev = elem;
-        elem = elem->next;
-        LOCK(elem->lock);
+        elem = next_node(the_list, elem);
+        LIST_VISIT();
+        LOCK(&elem->lock);
     }
 
     /* just check if the last node in the list is not equal to val */
@@ -211,18 +381,58 @@ bool list_remove(list_t *the_list, val_t val)
         prev->next = elem->next;
 
         /* unlock and deallocate mem */
-        UNLOCK(elem->lock);
-        DESTROY_LOCK(elem->lock);
-        free(elem->lock);
-        free(elem);
+        UNLOCK(&elem->lock);
+        DESTROY_LOCK(&elem->lock);
+        free_node(the_list, elem);
+        bloom_remove(&the_list->bloom, val);
 
         /* success */
-        UNLOCK(prev->lock);
+        UNLOCK(&prev->lock);
         return true;
     }
 
     /* we did not find it; unlock and report failure */
-    UNLOCK(elem->lock);
-    UNLOCK(prev->lock);
+    UNLOCK(&elem->lock);
+    UNLOCK(&prev->lock);
     return false;
 }
+
+bool list_save(list_t *the_list, const char *path)
+{
+    list_iter_t *it = list_iter_new(the_list);
+    bool ok = image_write(path, it->vals, it->size);
+    list_iter_delete(it);
+    return ok;
+}
+
+/* Create a list of the size values in vals, which are strictly ascending.
+ * The nodes are appended one after the other with no search, and end up laid
+ * out in the arena in key order.
+ */
+static list_t *list_build(const val_t *vals, uint64_t size)
+{
+    /* the list is not shared yet, there is no need to synchronize */
+    list_t *the_list = list_new();
+    node_t *elem = the_list->head;
+    for (uint64_t i = 0; i < size; i++) {
+        bloom_add(&the_list->bloom, vals[i]);
+        node_t *new_elem = new_node(the_list, vals[i], 0);
+        elem->next = get_idx(the_list, new_elem);
+        elem = new_elem;
+    }
+    return the_list;
+}
+
+list_t *list_load(const char *path)
+{
+    uint64_t size;
+    size_t length;
+    /* the null index and the sentinel take 2 nodes of the arena */
+    const val_t *vals = image_map(path, ARENA_CAPACITY - 2, &size, &length);
+    if (!vals)
+        return NULL;
+
+    list_t *the_list = list_build(vals, size);
+    image_unmap(vals, length);
+    return the_list;
+}
@@ -1,39 +1,273 @@
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+#include "backoff.h"
+#include "bloom.h"
+#include "elimination.h"
+#include "image.h"
 #include "list.h"
+#include "utils.h"
+
+/* A link is the arena index of the next node shifted left by one, which
+ * leaves the low-order bit free for the mark.
+ */
+typedef uint32_t link_t;
 
 struct node {
     val_t data;
-    struct node *next;
+    link_t next;
+    uint32_t limbo; /* index of the next unlinked node awaiting reclamation */
 };
 
+/* Snapshots follow the snap-collector of Petrank and Timnat ("Lock-free
+ * data-structure iterators", DISC 2013). While a snapshot traverses the list,
+ * updaters report the nodes they insert or logically delete, so that the
+ * snapshot can account for changes its traversal raced with.
+ */
+enum { REPORT_INSERT, REPORT_DELETE };
+
+typedef struct report {
+    node_t *node;
+    int type;
+    struct report *next;
+} report_t;
+
+/* installed on a collector's stack once it stops accepting reports */
+#define REPORTS_BLOCKED ((report_t *) 0x1L)
+
+typedef struct snap_collector {
+    report_t *reports;           /* lock-free stack of reports */
+    struct snap_collector *next; /* collector of the previous snapshot */
+} snap_collector_t;
+
 struct list {
     node_t *head, *tail;
-    uint32_t size;
+    arena_t arena;
+    snap_collector_t *snap;  /* collector of the ongoing snapshot, if any */
+    snap_collector_t *snaps; /* all the collectors, freed with the list */
+    uint32_t snap_lock;      /* serializes the snapshot takers */
+    uint32_t collecting;     /* snapshots whose reports may name nodes */
+    uint64_t limbo[3];       /* unlinked nodes by epoch: epoch << 32 | index */
+    uint32_t retired;        /* nodes unlinked and not reclaimed yet */
+    elim_t elim;             /* where opposite updates of a value cancel out */
+    bloom_t bloom;           /* filter of the values, counted before insertion */
 };
 
+struct list_iter {
+    val_t *vals; /* values of the snapshot, in ascending order */
+    int size;
+    int pos;
+};
+
+#if defined(LIST_STATS)
+__thread unsigned long list_visited;
+#endif
+/* random state of the pops of each thread, seeded on first use */
+static __thread uint64_t spray_seeds[3];
+#if defined(BLOOM)
+__thread unsigned long list_filtered;
+#endif
+
+/* Unlinked nodes are reclaimed by epochs (Fraser, "Practical lock-freedom",
+ * 2004). Each thread announces in a slot of its own the global epoch it saw
+ * when its current operation started. The epoch only moves on once all the
+ * operations in progress have seen it, so the nodes unlinked during epoch e
+ * can no longer be reached by any operation once it is e + 2.
+ */
+#ifndef LIST_MAX_READERS
+#define LIST_MAX_READERS 1024
+#endif
+
+typedef struct reader {
+    uint64_t epoch ALIGNED(64); /* epoch seen, shifted left; odd during an op */
+    uint32_t taken;             /* set while a thread owns the slot */
+} reader_t;
+
+static reader_t readers[LIST_MAX_READERS];
+static uint32_t n_readers; /* slots ever taken, to bound the scans */
+static uint64_t list_epoch;
+static __thread reader_t *reader_me;
+static pthread_key_t reader_key;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+
+/* the slot of a thread is given back when the thread exits */
+static void reader_release(void *slot)
+{
+    reader_t *r = slot;
+    __atomic_store_n(&r->taken, 0, __ATOMIC_RELEASE);
+}
+
+static void reader_key_create(void)
+{
+    if (pthread_key_create(&reader_key, reader_release) != 0) {
+        perror("pthread_key_create");
+        exit(1);
+    }
+}
+
+static reader_t *reader_slot(void)
+{
+    if (reader_me)
+        return reader_me;
+    pthread_once(&reader_once, reader_key_create);
+    for (uint32_t i = 0; i < LIST_MAX_READERS; i++) {
+        if (CAS_U32(&readers[i].taken, 0, 1) == 0) {
+            uint32_t n = __atomic_load_n(&n_readers, __ATOMIC_RELAXED);
+            while (n <= i && CAS_U32(&n_readers, n, i + 1) != n)
+                n = __atomic_load_n(&n_readers, __ATOMIC_RELAXED);
+            reader_me = &readers[i];
+            pthread_setspecific(reader_key, reader_me);
+            return reader_me;
+        }
+    }
+    fprintf(stderr, "more than %d threads use lock-free lists\n",
+            LIST_MAX_READERS);
+    exit(1);
+}
+
+/* announce an operation: the nodes it reaches are not reclaimed until it
+ * calls epoch_leave
+ */
+static void epoch_enter(void)
+{
+    reader_t *r = reader_slot();
+    uint64_t e = __atomic_load_n(&list_epoch, __ATOMIC_SEQ_CST);
+    while (1) {
+        __atomic_store_n(&r->epoch, e << 1 | 1, __ATOMIC_SEQ_CST);
+        uint64_t now = __atomic_load_n(&list_epoch, __ATOMIC_SEQ_CST);
+        if (now == e)
+            return;
+        e = now;
+    }
+}
+
+static void epoch_leave(void)
+{
+    __atomic_store_n(&reader_me->epoch, reader_me->epoch & ~1ULL,
+                     __ATOMIC_RELEASE);
+}
+
+/* move the epoch on if all the operations in progress have seen it */
+static void epoch_advance(void)
+{
+    uint64_t e = __atomic_load_n(&list_epoch, __ATOMIC_SEQ_CST);
+    uint32_t n = __atomic_load_n(&n_readers, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t r = __atomic_load_n(&readers[i].epoch, __ATOMIC_SEQ_CST);
+        if ((r & 1) && (r >> 1) != e)
+            return;
+    }
+    CAS_U64(&list_epoch, e, e + 1);
+}
+
 /* The following functions handle the low-order mark bit that indicates
  * whether a node is logically deleted (1) or not (0).
  *  - is_marked_ref returns whether it is marked,
  *  - (un)set_marked changes the mark,
- *  - get_(un)marked_ref sets the mark before returning the node.
+ *  - get_(un)marked_ref sets the mark before returning the link.
+ */
+static inline bool is_marked_ref(link_t i)
+{
+    return (bool) (i & 0x1U);
+}
+
+static inline link_t get_unmarked_ref(link_t w)
+{
+    return w & ~0x1U;
+}
+
+static inline link_t get_marked_ref(link_t w)
+{
+    return w | 0x1U;
+}
+
+/* get_node follows a link, whatever its mark; get_ref builds an unmarked
+ * link to node.
  */
-static inline bool is_marked_ref(void *i)
+static inline node_t *get_node(list_t *the_list, link_t ref)
+{
+    return arena_get(&the_list->arena, ref >> 1);
+}
+
+static inline link_t get_ref(list_t *the_list, node_t *node)
 {
-    return (bool) ((uintptr_t) i & 0x1L);
+    return (link_t) (((char *) node - the_list->arena.base) /
+                     sizeof(node_t))
+           << 1;
 }
 
-static inline void *get_unmarked_ref(void *w)
+/* Tell the ongoing snapshot, if any, that node was inserted or deleted. */
+static void report(list_t *the_list, node_t *node, int type)
 {
-    return (void *) ((uintptr_t) w & ~0x1L);
+    snap_collector_t *sc = __atomic_load_n(&the_list->snap, __ATOMIC_SEQ_CST);
+    if (!sc)
+        return;
+    /* a node deleted in the meantime must not be reported as inserted */
+    if (type == REPORT_INSERT && is_marked_ref(node->next))
+        return;
+
+    report_t *r = malloc(sizeof(report_t));
+    r->node = node;
+    r->type = type;
+    report_t *head = __atomic_load_n(&sc->reports, __ATOMIC_SEQ_CST);
+    while (head != REPORTS_BLOCKED) {
+        r->next = head;
+        report_t *old = CAS_PTR(&(sc->reports), head, r);
+        if (old == head)
+            return;
+        head = old;
+    }
+    /* the snapshot is already over */
+    free(r);
 }
 
-static inline void *get_marked_ref(void *w)
+/* Put the n nodes unlinked from first to end, excluded, in the limbo of the
+ * epoch the calling operation announced. The limbo of an epoch is shared with
+ * the epochs 3 apart: the nodes found there from 3 epochs ago or more can no
+ * longer be reached, and are given back to the arena, unless a snapshot is
+ * being taken, whose reports may still name them.
+ */
+static void retire(list_t *set, link_t first, link_t end, uint32_t n)
 {
-    return (void *) ((uintptr_t) w | 0x1L);
+    __atomic_fetch_add(&set->retired, n, __ATOMIC_RELAXED);
+    node_t *last = NULL;
+    for (link_t d = first; d != end; d = get_unmarked_ref(last->next)) {
+        last = get_node(set, d);
+        last->limbo = get_unmarked_ref(last->next) == end
+                          ? 0
+                          : get_unmarked_ref(last->next) >> 1;
+    }
+
+    uint32_t e = (uint32_t) (reader_me->epoch >> 1);
+    uint64_t *slot = &set->limbo[(reader_me->epoch >> 1) % 3];
+    uint64_t head = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint32_t below = (uint32_t) head, reclaim = 0;
+        if ((uint32_t) (head >> 32) != e &&
+            !__atomic_load_n(&set->collecting, __ATOMIC_SEQ_CST)) {
+            reclaim = below;
+            below = 0;
+        }
+        last->limbo = below;
+        uint64_t new_head = (uint64_t) e << 32 | first >> 1;
+        uint64_t old = CAS_U64(slot, head, new_head);
+        if (old == head) {
+            while (reclaim) {
+                uint32_t next = get_node(set, reclaim << 1)->limbo;
+                arena_free(&set->arena, reclaim);
+                __atomic_fetch_sub(&set->retired, 1, __ATOMIC_RELAXED);
+                reclaim = next;
+            }
+            break;
+        }
+        head = old;
+    }
+    epoch_advance();
 }
 
 /* list_search looks for value val, it
@@ -42,35 +276,50 @@ static inline void *get_marked_ref(void *w)
  *  - sets the left_node to the node owning the value immediately lower than
  *    val.
  * Encountered nodes that are marked as logically deleted are physically removed
- * from the list, yet not garbage collected.
+ * from the list, and retired. Failed CASes back off with the
+ * backoff of the calling operation.
  */
-static node_t *list_search(list_t *set, val_t val, node_t **left_node)
+static node_t *list_search(list_t *set, val_t val, node_t **left_node,
+                           backoff_t *backoff)
 {
-    node_t *left_node_next, *right_node;
-    left_node_next = right_node = NULL;
+    link_t left_node_next, right_ref;
+    node_t *right_node;
+    left_node_next = 0;
     while (1) {
         node_t *t = set->head;
-        node_t *t_next = set->head->next;
+        link_t t_next = set->head->next;
         while (is_marked_ref(t_next) || (t->data < val)) {
             if (!is_marked_ref(t_next)) {
                 (*left_node) = t;
                 left_node_next = t_next;
             }
-            t = get_unmarked_ref(t_next);
+            t = get_node(set, t_next);
+            LIST_VISIT();
             if (t == set->tail)
                 break;
             t_next = t->next;
         }
         right_node = t;
+        right_ref = get_ref(set, t);
 
-        if (left_node_next == right_node) {
+        if (left_node_next == right_ref) {
             if (!is_marked_ref(right_node->next))
                 return right_node;
         } else {
-            if (CAS_PTR(&((*left_node)->next), left_node_next, right_node) ==
+            /* deletions are reported before the nodes become unreachable */
+            uint32_t n_unlinked = 0;
+            for (link_t d = left_node_next; d != right_ref;
+                 d = get_unmarked_ref(get_node(set, d)->next)) {
+                report(set, get_node(set, d), REPORT_DELETE);
+                n_unlinked++;
+            }
+            if (CAS_U32(&((*left_node)->next), left_node_next, right_ref) ==
                 left_node_next) {
+                retire(set, left_node_next, right_ref, n_unlinked);
                 if (!is_marked_ref(right_node->next))
                     return right_node;
+            } else {
+                backoff_wait(backoff);
             }
         }
     }
@@ -79,22 +328,38 @@ static node_t *list_search(list_t *set, val_t val, node_t **left_node)
 /* return true if there is a node in the list owning value val. */
 bool list_contains(list_t *the_list, val_t val)
 {
-    node_t *iterator = get_unmarked_ref(the_list->head->next);
+    if (!bloom_contains(&the_list->bloom, val)) {
+#if defined(BLOOM)
+        list_filtered++;
+#endif
+        return false;
+    }
+
+    epoch_enter();
+    bool found = false;
+    node_t *iterator = get_node(the_list, the_list->head->next);
     while (iterator != the_list->tail) {
         if (!is_marked_ref(iterator->next) && iterator->data >= val) {
             /* either we found it, or found the first larger element */
-            return iterator->data == val;
+            found = iterator->data == val;
+            if (found)
+                report(the_list, iterator, REPORT_INSERT);
+            break;
         }
+        if (iterator->data == val) /* found it logically deleted */
+            report(the_list, iterator, REPORT_DELETE);
 
-        /* always get unmarked pointer */
-        iterator = get_unmarked_ref(iterator->next);
+        /* get_node ignores the mark */
+        iterator = get_node(the_list, iterator->next);
+        LIST_VISIT();
     }
-    return false;
+    epoch_leave();
+    return found;
 }
 
-static node_t *new_node(val_t val, node_t *next)
+static node_t *new_node(list_t *the_list, val_t val, link_t next)
 {
-    node_t *node = malloc(sizeof(node_t));
+    node_t *node = get_node(the_list, arena_alloc(&the_list->arena) << 1);
     node->data = val;
     node->next = next;
     return node;
@@ -105,38 +370,321 @@ list_t *list_new()
     /* allocate list */
     list_t *the_list = malloc(sizeof(list_t));
 
+    /* reserve the address space of the nodes */
+    arena_init(&the_list->arena, sizeof(node_t), ARENA_CAPACITY);
+
     /* now need to create the sentinel node */
-    the_list->head = new_node(INT_MIN, NULL);
-    the_list->tail = new_node(INT_MAX, NULL);
-    the_list->head->next = the_list->tail;
-    the_list->size = 0;
+    the_list->head = new_node(the_list, INT_MIN, 0);
+    the_list->tail = new_node(the_list, INT_MAX, 0);
+    the_list->head->next = get_ref(the_list, the_list->tail);
+    the_list->snap = NULL;
+    the_list->snaps = NULL;
+    the_list->snap_lock = 0;
+    the_list->collecting = 0;
+    for (int i = 0; i < 3; i++)
+        the_list->limbo[i] = 0;
+    the_list->retired = 0;
+    elim_init(&the_list->elim);
+    bloom_init(&the_list->bloom);
     return the_list;
 }
 
+/* must not run concurrently with any other operation on the list */
 void list_delete(list_t *the_list)
 {
-    /* FIXME: implement the deletion */
+    /* the nodes in limbo go away with the arena */
+    arena_destroy(&the_list->arena);
+    while (the_list->snaps) {
+        snap_collector_t *sc = the_list->snaps;
+        the_list->snaps = sc->next;
+        free(sc);
+    }
+    bloom_destroy(&the_list->bloom);
+    free(the_list);
+}
+
+static bool pop_min(list_t *the_list, val_t *val, backoff_t *backoff)
+{
+    node_t *left = NULL;
+    while (1) {
+        /* the first node that is not logically deleted */
+        node_t *right =
+            list_search(the_list, the_list->head->data + 1, &left, backoff);
+        if (right == the_list->tail)
+            return false;
+
+        link_t right_succ = right->next;
+        if (!is_marked_ref(right_succ)) {
+            if (CAS_U32(&(right->next), right_succ,
+                        get_marked_ref(right_succ)) == right_succ) {
+                report(the_list, right, REPORT_DELETE);
+                *val = right->data;
+                bloom_remove(&the_list->bloom, *val);
+                return true;
+            }
+            backoff_wait(backoff);
+        }
+    }
+}
+
+bool list_pop_min(list_t *the_list, val_t *val)
+{
+    backoff_t backoff;
+    backoff_init(&backoff);
+    epoch_enter();
+    bool popped = pop_min(the_list, val, &backoff);
+    epoch_leave();
+    return popped;
+}
+
+/* Count the values smaller than val still in the list. Called right after
+ * val was popped, this measures how far from the minimum the pop was.
+ */
+static int count_smaller(list_t *the_list, val_t val)
+{
+    int n = 0;
+    node_t *iterator = get_node(the_list, the_list->head->next);
+    while (iterator != the_list->tail && iterator->data < val) {
+        if (!is_marked_ref(iterator->next))
+            n++;
+        iterator = get_node(the_list, iterator->next);
+    }
+    return n;
+}
+
+/* Inspired by the SprayList (Alistarh et al., PPoPP 2015), with a plain walk
+ * over the first width nodes in place of the skip list random jumps.
+ */
+bool list_pop_spray(list_t *the_list, int width, val_t *val, int *skipped)
+{
+    node_t *left = NULL;
+    backoff_t backoff;
+    backoff_init(&backoff);
+    uint64_t *s = spray_seeds;
+    if (!s[0])
+        seed_rand_thread(s);
+    epoch_enter();
+    while (1) {
+        int target = 0;
+        if (width > 1)
+            target = my_random(&s[0], &s[1], &s[2]) % width;
+
+        /* walk to the node holding the target-th smallest value, or to the
+         * last one if the list is shorter than that.
+         */
+        node_t *node = NULL;
+        int rank = -1;
+        node_t *iterator = get_node(the_list, the_list->head->next);
+        while (iterator != the_list->tail && rank < target) {
+            if (!is_marked_ref(iterator->next)) {
+                node = iterator;
+                rank++;
+            }
+            iterator = get_node(the_list, iterator->next);
+        }
+        if (!node) { /* only the strict version can tell the list is empty */
+            bool popped = pop_min(the_list, val, &backoff);
+            if (popped && skipped)
+                *skipped = count_smaller(the_list, *val);
+            epoch_leave();
+            return popped;
+        }
+
+        link_t succ = node->next;
+        if (!is_marked_ref(succ)) {
+            if (CAS_U32(&(node->next), succ, get_marked_ref(succ)) == succ) {
+                report(the_list, node, REPORT_DELETE);
+                *val = node->data;
+                bloom_remove(&the_list->bloom, *val);
+                /* the rank of node during the walk is stale by now: other
+                 * pops may have taken smaller values since, and inserts
+                 * added some.
+                 */
+                if (skipped)
+                    *skipped = count_smaller(the_list, *val);
+                /* unlink it, lest the head of the list fill up with
+                 * logically deleted nodes.
+                 */
+                list_search(the_list, node->data, &left, &backoff);
+                epoch_leave();
+                return true;
+            }
+            backoff_wait(&backoff);
+        }
+    }
+}
+
+static int cmp_node_data(const void *a, const void *b)
+{
+    const node_t *x = *(node_t *const *) a, *y = *(node_t *const *) b;
+    if (x->data != y->data)
+        return x->data < y->data ? -1 : 1;
+    return (x > y) - (x < y);
+}
+
+static int cmp_node_addr(const void *a, const void *b)
+{
+    const node_t *x = *(node_t *const *) a, *y = *(node_t *const *) b;
+    return (x > y) - (x < y);
+}
+
+static void push_node(node_t ***nodes, int *size, int *cap, node_t *node)
+{
+    if (*size == *cap) {
+        *cap *= 2;
+        *nodes = realloc(*nodes, *cap * sizeof(node_t *));
+    }
+    (*nodes)[(*size)++] = node;
+}
+
+/* Take a snapshot of the list and store its values in ascending order into
+ * the newly allocated *vals.
+ * @return the number of values
+ */
+static int list_collect(list_t *the_list, val_t **vals)
+{
+    /* one snapshot at a time; updaters never wait for this lock */
+    while (CAS_U32(&(the_list->snap_lock), 0, 1) == 1)
+        ;
+    epoch_enter();
+    __atomic_fetch_add(&the_list->collecting, 1, __ATOMIC_SEQ_CST);
+
+    /* the collector is only freed with the list: a slow updater may still
+     * hold a reference to it.
+     */
+    snap_collector_t *sc = malloc(sizeof(snap_collector_t));
+    sc->reports = NULL;
+    sc->next = the_list->snaps;
+    the_list->snaps = sc;
+    __atomic_store_n(&the_list->snap, sc, __ATOMIC_SEQ_CST);
+
+    int n_nodes = 0, cap_nodes = 64;
+    node_t **nodes = malloc(cap_nodes * sizeof(node_t *));
+    node_t *iterator = get_node(the_list, the_list->head->next);
+    while (iterator != the_list->tail) {
+        if (!is_marked_ref(iterator->next))
+            push_node(&nodes, &n_nodes, &cap_nodes, iterator);
+        iterator = get_node(the_list, iterator->next);
+    }
+
+    /* stop accepting reports; the snapshot is linearized here */
+    report_t *r = __atomic_exchange_n(&sc->reports, REPORTS_BLOCKED,
+                                      __ATOMIC_SEQ_CST);
+    __atomic_store_n(&the_list->snap, NULL, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&the_list->snap_lock, 0, __ATOMIC_RELEASE);
+
+    /* reported insertions join the collected nodes, reported deletions are
+     * then filtered out.
+     */
+    int n_deleted = 0, cap_deleted = 64;
+    node_t **deleted = malloc(cap_deleted * sizeof(node_t *));
+    while (r) {
+        report_t *next = r->next;
+        if (r->type == REPORT_INSERT)
+            push_node(&nodes, &n_nodes, &cap_nodes, r->node);
+        else
+            push_node(&deleted, &n_deleted, &cap_deleted, r->node);
+        free(r);
+        r = next;
+    }
+    qsort(nodes, n_nodes, sizeof(node_t *), cmp_node_data);
+    qsort(deleted, n_deleted, sizeof(node_t *), cmp_node_addr);
+
+    int size = 0;
+    *vals = malloc((n_nodes ? n_nodes : 1) * sizeof(val_t));
+    for (int i = 0; i < n_nodes; i++) {
+        /* a node may have been both collected and reported */
+        if (i > 0 && nodes[i] == nodes[i - 1])
+            continue;
+        if (bsearch(&nodes[i], deleted, n_deleted, sizeof(node_t *),
+                    cmp_node_addr))
+            continue;
+        (*vals)[size++] = nodes[i]->data;
+    }
+
+    free(nodes);
+    free(deleted);
+    __atomic_fetch_sub(&the_list->collecting, 1, __ATOMIC_SEQ_CST);
+    epoch_leave();
+    return size;
 }
 
 int list_size(list_t *the_list)
 {
-    return the_list->size;
+    val_t *vals;
+    int size = list_collect(the_list, &vals);
+    free(vals);
+    return size;
+}
+
+void list_mem(list_t *the_list, list_mem_t *mem)
+{
+    /* unlinked nodes stay allocated until no thread can read them */
+    mem->retired = __atomic_load_n(&the_list->retired, __ATOMIC_RELAXED);
+    mem->live = arena_used(&the_list->arena) - mem->retired;
+    mem->free = __atomic_load_n(&the_list->arena.n_free, __ATOMIC_RELAXED);
+    mem->bytes = sizeof(list_t) + arena_bytes(&the_list->arena) +
+                 bloom_bytes(&the_list->bloom);
+}
+
+list_iter_t *list_iter_new(list_t *the_list)
+{
+    list_iter_t *it = malloc(sizeof(list_iter_t));
+    it->size = list_collect(the_list, &it->vals);
+    it->pos = 0;
+    return it;
+}
+
+bool list_iter_next(list_iter_t *it, val_t *val)
+{
+    if (it->pos == it->size)
+        return false;
+    *val = it->vals[it->pos++];
+    return true;
+}
+
+void list_iter_delete(list_iter_t *it)
+{
+    free(it->vals);
+    free(it);
 }
 
 bool list_add(list_t *the_list, val_t val)
 {
     node_t *left = NULL;
-    node_t *new_elem = new_node(val, NULL);
+    node_t *new_elem = new_node(the_list, val, 0);
+    link_t new_ref = get_ref(the_list, new_elem);
+    backoff_t backoff;
+    backoff_init(&backoff);
+    /* count val before it can be found in the list */
+    bloom_add(&the_list->bloom, val);
+    epoch_enter();
     while (1) {
-        node_t *right = list_search(the_list, val, &left);
-        if (right != the_list->tail && right->data == val)
+        node_t *right = list_search(the_list, val, &left, &backoff);
+        if (right != the_list->tail && right->data == val) {
+            report(the_list, right, REPORT_INSERT);
+            epoch_leave();
+            bloom_remove(&the_list->bloom, val);
+            /* new_elem was never published, it can be reused right away */
+            arena_free(&the_list->arena, new_ref >> 1);
             return false;
+        }
 
-        new_elem->next = right;
-        if (CAS_PTR(&(left->next), right, new_elem) == right) {
-            FAI_U32(&(the_list->size));
+        link_t right_ref = get_ref(the_list, right);
+        new_elem->next = right_ref;
+        if (CAS_U32(&(left->next), right_ref, new_ref) == right_ref) {
+            report(the_list, new_elem, REPORT_INSERT);
+            epoch_leave();
             return true;
         }
+        /* contended: try to cancel out with a remove of val instead */
+        if (elim_exchange(&the_list->elim, ELIM_ADD, val)) {
+            epoch_leave();
+            bloom_remove(&the_list->bloom, val);
+            arena_free(&the_list->arena, new_ref >> 1);
+            return true;
+        }
+        backoff_wait(&backoff);
     }
 }
 
@@ -144,19 +692,73 @@ bool list_add(list_t *the_list, val_t val)
 bool list_remove(list_t *the_list, val_t val)
 {
     node_t *left = NULL;
+    backoff_t backoff;
+    backoff_init(&backoff);
+    epoch_enter();
     while (1) {
-        node_t *right = list_search(the_list, val, &left);
+        node_t *right = list_search(the_list, val, &left, &backoff);
         /* check if we found our node */
-        if ((right == the_list->tail) || (right->data != val))
+        if ((right == the_list->tail) || (right->data != val)) {
+            epoch_leave();
             return false;
+        }
 
-        node_t *right_succ = right->next;
+        link_t right_succ = right->next;
         if (!is_marked_ref(right_succ)) {
-            if (CAS_PTR(&(right->next), right_succ,
+            if (CAS_U32(&(right->next), right_succ,
                         get_marked_ref(right_succ)) == right_succ) {
-                FAD_U32(&(the_list->size));
+                report(the_list, right, REPORT_DELETE);
+                epoch_leave();
+                bloom_remove(&the_list->bloom, val);
+                return true;
+            }
+            /* contended: try to cancel out with an add of val instead */
+            if (elim_exchange(&the_list->elim, ELIM_REMOVE, val)) {
+                epoch_leave();
                 return true;
             }
+            backoff_wait(&backoff);
         }
     }
 }
+
+bool list_save(list_t *the_list, const char *path)
+{
+    list_iter_t *it = list_iter_new(the_list);
+    bool ok = image_write(path, it->vals, it->size);
+    list_iter_delete(it);
+    return ok;
+}
+
+/* Create a list of the size values in vals, which are strictly ascending.
+ * The nodes are appended one after the other with no search, and end up laid
+ * out in the arena in key order.
+ */
+static list_t *list_build(const val_t *vals, uint64_t size)
+{
+    /* the list is not shared yet, there is no need to synchronize */
+    list_t *the_list = list_new();
+    node_t *elem = the_list->head;
+    for (uint64_t i = 0; i < size; i++) {
+        bloom_add(&the_list->bloom, vals[i]);
+        node_t *new_elem = new_node(the_list, vals[i], 0);
+        elem->next = get_ref(the_list, new_elem);
+        elem = new_elem;
+    }
+    elem->next = get_ref(the_list, the_list->tail);
+    return the_list;
+}
+
+list_t *list_load(const char *path)
+{
+    uint64_t size;
+    size_t length;
+    /* the null index and the sentinels take 3 nodes of the arena */
+    const val_t *vals = image_map(path, ARENA_CAPACITY - 3, &size, &length);
+    if (!vals)
+        return NULL;
+
+    list_t *the_list = list_build(vals, size);
+    image_unmap(vals, length);
+    return the_list;
+}
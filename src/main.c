@@ -1,12 +1,17 @@
 #include <getopt.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "histogram.h"
 #include "list.h"
 #include "utils.h"
 
@@ -26,9 +31,45 @@
 /* the maximum value the key stored in the list can take; defines key range */
 #define DEFAULT_RANGE 2048
 
+/* options with no short equivalent */
+enum { OPT_LOAD = 256, OPT_SAVE, OPT_SPRAY, OPT_POISSON, OPT_SWEEP,
+       OPT_REFILL };
+
+/* default interval between two snapshots in miliseconds (0 = no snapshots) */
+#define DEFAULT_SNAPSHOT 0
+
+/* interval between two samples of the resident set size in miliseconds */
+#define RSS_INTERVAL 100
+
+/* in priority queue mode, the rank error is measured on one pop out of
+ * RANK_SAMPLE only, as the lock-free list walks its head to measure it
+ */
+#define RANK_SAMPLE 64
+
 static uint32_t finds;
 static uint32_t max_key;
 
+/* hot key mode: updates only touch hot_keys values, hot_stride apart */
+static uint32_t hot_keys, hot_stride;
+
+/* percentage of the searches for values out of the key range, which miss */
+static uint32_t misses;
+
+/* priority queue mode: half of the threads produce, the others pop one of
+ * the spray_width smallest values.
+ */
+static bool pq_mode;
+static int spray_width = 1;
+
+/* open loop mode: mean time between two operations of a thread (ns), with
+ * either a fixed interval or Poisson arrivals. 0 means closed loop.
+ */
+static double arrival_interval;
+static bool poisson;
+
+/* sweep mode: each experiment refills the list with its own threads */
+static bool sweep_refill;
+
 /* used to signal the threads when to stop */
 static ALIGNED(64) uint8_t running[64];
 
@@ -37,6 +78,13 @@ __thread uint64_t *seeds;
 
 static list_t *the_list;
 
+/* resident set size at the start and the end of the experiment, and its
+ * maximum in between (KiB); 0 if it cannot be read
+ */
+static struct {
+    long start, max, end;
+} rss;
+
 /* a simple barrier implementation, used to make sure all threads start the
  * experiment at the same time.
  */
@@ -71,16 +119,104 @@ void barrier_cross(barrier_t *b)
 /* data structure through which we send parameters to and get results from the
  * worker threads.
  */
-typedef ALIGNED(64) struct thread_data {
+typedef struct ALIGNED(64) thread_data {
     barrier_t *barrier;  /* pointer to the global barrier */
     unsigned long n_ops; /* operations each thread performs */
     uint64_t n_add; /* elements each thread should add at beginning of exec */
+    const val_t *fill; /* the elements to add, random ones if NULL */
     unsigned long n_insert; /* number of inserts a thread performs */
     unsigned long n_remove; /* number of removes a thread performs */
     unsigned long n_search; /* number of searches a thread performs */
+    unsigned long n_missed; /* number of searches that did not find */
+    unsigned long n_filtered; /* searches the filter of the list answered */
+    unsigned long n_pop;    /* number of pops a thread performs */
+    unsigned long n_empty;  /* number of pops that found the list empty */
+    unsigned long n_ranked; /* pops whose rank error was measured */
+    unsigned long rank_sum; /* sum of the rank errors of those pops */
+    int rank_max;           /* largest rank error of those pops */
+    histogram_t latency;    /* latencies of the operations (ns), open loop */
+    struct thread_data *pair; /* in priority queue mode, see test_pq */
     int id; /* the id of the thread (used for thread placement on cores) */
 } thread_data_t;
 
+/* before starting the test, we insert a number of elements in the data
+ * structure.
+ * we do this at each thread to avoid the situation where the entire data
+ * structure resides in the same memory node.
+ */
+static void prefill(thread_data_t *d)
+{
+    if (d->fill) { /* replay the share of the thread */
+        for (uint64_t i = 0; i < d->n_add; i++)
+            list_add(the_list, d->fill[i]);
+        return;
+    }
+    for (int i = 0; i < d->n_add; ++i) {
+        val_t the_value =
+            (val_t) my_random(&seeds[0], &seeds[1], &seeds[2]) & max_key;
+        /* we make sure the insert was effective (as opposed to just updating an
+         * existing entry).
+         */
+        if (list_add(the_list, the_value) == 0)
+            i--;
+    }
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* return the time until the next arrival of the open loop (ns) */
+static double next_arrival(void)
+{
+    if (!poisson)
+        return arrival_interval;
+    /* inverse transform sampling of the exponential distribution */
+    double u = (my_random(&seeds[0], &seeds[1], &seeds[2]) >> 11) * 0x1.0p-53;
+    return -log1p(-u) * arrival_interval;
+}
+
+/* Wait until time due (ns), sleeping if it is far enough and then spinning.
+ * @return false if the test ended meanwhile
+ */
+static bool wait_until(uint64_t due)
+{
+    uint64_t now;
+    while ((now = now_ns()) < due) {
+        if (!*running)
+            return false;
+        if (due - now > 50000) {
+            uint64_t nap = due - now - 20000;
+            struct timespec ts = {0, nap < 1000000 ? nap : 1000000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    return true;
+}
+
+/* resident set size of the process (kB) */
+static long rss_kb(void)
+{
+    long pages;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    if (fscanf(f, "%*d %ld", &pages) != 1)
+        pages = 0;
+    fclose(f);
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void rss_sample(void)
+{
+    rss.end = rss_kb();
+    if (rss.end > rss.max)
+        rss.max = rss.end;
+}
+
 void *test(void *data)
 {
     thread_data_t *d = (thread_data_t *) data; /* per-thread data */
@@ -95,30 +231,34 @@ void *test(void *data)
     val_t the_value;
     int last = -1;
 
-    /* before starting the test, we insert a number of elements in the data
-     * structure.
-     * we do this at each thread to avoid the situation where the entire data
-     * structure resides in the same memory node.
-     */
-    for (int i = 0; i < d->n_add; ++i) {
-        the_value =
-            (val_t) my_random(&seeds[0], &seeds[1], &seeds[2]) & rand_max;
-        /* we make sure the insert was effective (as opposed to just updating an
-         * existing entry).
-         */
-        if (list_add(the_list, the_value) == 0)
-            i--;
-    }
+    prefill(d);
 
     /* Wait on barrier */
     barrier_cross(d->barrier);
+    /* in open loop, operations are issued on a schedule and their latency is
+     * measured from when they were due, which accounts for the time they
+     * spend queued behind late ones (coordinated omission).
+     */
+    uint64_t start = now_ns();
+    double due = 0; /* since start (ns) */
     while (*running) { /* start the test */
+        if (arrival_interval > 0) {
+            due += next_arrival();
+            if (!wait_until(start + (uint64_t) due))
+                break;
+        }
         /* generate value (node that rand_max is expected to be power of 2) */
         the_value = my_random(&seeds[0], &seeds[1], &seeds[2]) & rand_max;
         /* generate the operation */
         uint32_t op = my_random(&seeds[0], &seeds[1], &seeds[2]) & 0xff;
+        if (op >= read_thresh && hot_keys > 0) /* use one of the hot keys */
+            the_value = (the_value % hot_keys) * hot_stride + hot_stride / 2;
         if (op < read_thresh) { /* do a find operation */
-            list_contains(the_list, the_value);
+            if ((op * 100) / read_thresh < misses)
+                the_value += max_key + 1;
+            if (!list_contains(the_list, the_value))
+                d->n_missed++;
+            d->n_search++;
         } else if (last == -1) { /* do a write operation */
             if (list_add(the_list, the_value)) {
                 d->n_insert++;
@@ -130,6 +270,98 @@ void *test(void *data)
                 last = -1;
             }
         }
+        if (arrival_interval > 0)
+            hist_add(&d->latency, now_ns() - start - (uint64_t) due);
+        d->n_ops++;
+    }
+#if defined(BLOOM)
+    d->n_filtered = list_filtered;
+#endif
+    return NULL;
+}
+
+/* data through which the snapshot thread reports how snapshots went */
+typedef struct snapshot_data {
+    barrier_t *barrier;           /* pointer to the global barrier */
+    int interval;                 /* pause between two snapshots (ms) */
+    unsigned long n_snapshots;    /* number of snapshots taken */
+    unsigned long total_size;     /* sum of the sizes of the snapshots */
+    unsigned long total_latency;  /* time spent taking snapshots (us) */
+} snapshot_data_t;
+
+/* periodically iterate over a snapshot of the list while the worker threads
+ * keep updating it; comparing the throughput with and without this thread
+ * measures what snapshots cost to the updates.
+ */
+void *snapshot(void *data)
+{
+    snapshot_data_t *d = (snapshot_data_t *) data;
+    struct timespec pause, start, end;
+    pause.tv_sec = d->interval / 1000;
+    pause.tv_nsec = (d->interval % 1000) * 1000000;
+
+    barrier_cross(d->barrier);
+    while (*running) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        list_iter_t *it = list_iter_new(the_list);
+        val_t val;
+        while (list_iter_next(it, &val))
+            d->total_size++;
+        list_iter_delete(it);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        d->total_latency += (end.tv_sec - start.tv_sec) * 1000000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000;
+        d->n_snapshots++;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+/* producer/consumer test: even threads add random values, odd threads pop
+ * the smallest ones. A consumer pops no more values than the producer of its
+ * pair, the thread before it, added: the list stays about its initial size
+ * instead of being drained, and pops measure the removal of values rather
+ * than spins on an empty list. The last thread of an odd number of threads is
+ * its own pair, and pops what it added in turn.
+ */
+void *test_pq(void *data)
+{
+    thread_data_t *d = (thread_data_t *) data; /* per-thread data */
+    seeds = seed_rand(); /* the custom random number generator */
+    thread_data_t *pair = d->pair;
+    val_t the_value;
+    int rank;
+
+    prefill(d);
+
+    /* Wait on barrier */
+    barrier_cross(d->barrier);
+    while (*running) { /* start the test */
+        bool producer = (d->id % 2 == 0);
+        if (pair == d)
+            producer = d->n_pop + d->n_empty >= d->n_insert;
+        if (producer) {
+            the_value = my_random(&seeds[0], &seeds[1], &seeds[2]) & max_key;
+            if (list_add(the_list, the_value))
+                __atomic_store_n(&d->n_insert, d->n_insert + 1,
+                                 __ATOMIC_RELEASE);
+        } else if (d->n_pop + d->n_empty >=
+                   __atomic_load_n(&pair->n_insert, __ATOMIC_ACQUIRE)) {
+            sched_yield(); /* wait for the producer */
+            continue;
+        } else if (list_pop_spray(the_list, spray_width, &the_value,
+                                  d->n_pop % RANK_SAMPLE ? NULL : &rank)) {
+            if (d->n_pop % RANK_SAMPLE == 0) {
+                d->n_ranked++;
+                d->rank_sum += rank;
+                if (rank > d->rank_max)
+                    d->rank_max = rank;
+            }
+            d->n_pop++;
+        } else {
+            d->n_empty++;
+        }
         d->n_ops++;
     }
     return NULL;
@@ -143,16 +375,226 @@ void catcher(int sig)
         exit(1);
 }
 
-int main(int argc, char *const argv[])
+/* set the data for each thread; the threads share the insertion of n_fill
+ * elements before the experiment starts: random ones, or the ones in fill.
+ */
+static void init_data(thread_data_t *data, int n_threads, long n_fill,
+                      const val_t *fill)
 {
-    pthread_t *threads;
+    long first = 0;
+    for (int i = 0; i < n_threads; i++) {
+        data[i].id = i;
+        data[i].pair = &data[i % 2 ? i - 1 : (i + 1 < n_threads ? i + 1 : i)];
+        data[i].n_ops = 0;
+        data[i].n_insert = 0;
+        data[i].n_remove = 0;
+        data[i].n_search = 0;
+        data[i].n_missed = 0;
+        data[i].n_filtered = 0;
+        data[i].n_pop = 0;
+        data[i].n_empty = 0;
+        data[i].n_ranked = 0;
+        data[i].rank_sum = 0;
+        data[i].rank_max = 0;
+        hist_init(&data[i].latency);
+        data[i].n_add = n_fill / n_threads;
+        if (i < n_fill % n_threads)
+            data[i].n_add++;
+        data[i].fill = fill ? fill + first : NULL;
+        first += data[i].n_add;
+    }
+}
+
+/* Run an experiment with n_threads worker threads, plus the snapshot thread
+ * if snap is not NULL: the threads fill the list, then operate on it for
+ * duration milliseconds, until a signal if duration is 0, or not at all if
+ * duration is negative.
+ * @param start receives the time the experiment started, after the fill
+ * @return the exact duration of the experiment in milliseconds
+ */
+static int run(thread_data_t *data, int n_threads, int duration,
+               snapshot_data_t *snap, struct timeval *start)
+{
+    pthread_t *threads, snapshot_thread;
     pthread_attr_t attr;
     barrier_t barrier;
-    struct timeval start, end;
-    struct timespec timeout;
+    struct timeval end;
+    sigset_t block_set;
+
+    if ((threads = malloc(n_threads * sizeof(pthread_t))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    /* flag signaling the threads until when to run */
+    *running = 1;
+
+    /* global barrier init (used to start the threads at the same time) */
+    barrier_init(&barrier, n_threads + 1 + (snap != NULL));
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    /* create the threads */
+    for (int i = 0; i < n_threads; i++) {
+        data[i].barrier = &barrier;
+        if (pthread_create(&threads[i], &attr, pq_mode ? test_pq : test,
+                           (void *) (&data[i])) != 0) {
+            fprintf(stderr, "Error creating thread\n");
+            exit(1);
+        }
+    }
+    if (snap) {
+        snap->barrier = &barrier;
+        snap->n_snapshots = 0;
+        snap->total_size = 0;
+        snap->total_latency = 0;
+        if (pthread_create(&snapshot_thread, &attr, snapshot, (void *) snap) !=
+            0) {
+            fprintf(stderr, "Error creating thread\n");
+            exit(1);
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    /* Start threads, or only let them fill the list */
+    if (duration < 0)
+        *running = 0;
+    barrier_cross(&barrier);
+    gettimeofday(start, NULL);
+    rss.start = rss.max = rss.end = rss_kb();
+    if (duration > 0) {
+        /* sleep for the duration of the experiment, sampling the RSS */
+        uint64_t end_ns = now_ns() + duration * 1000000ULL, now;
+        while ((now = now_ns()) < end_ns) {
+            uint64_t nap = end_ns - now;
+            if (nap > RSS_INTERVAL * 1000000ULL)
+                nap = RSS_INTERVAL * 1000000ULL;
+            struct timespec ts = {nap / 1000000000, nap % 1000000000};
+            nanosleep(&ts, NULL);
+            rss_sample();
+        }
+    } else if (duration == 0) {
+        sigemptyset(&block_set);
+        sigsuspend(&block_set);
+    }
+
+    /* signal the threads to stop */
+    *running = 0;
+    gettimeofday(&end, NULL);
+    rss_sample();
+
+    /* Wait for thread completion */
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_join(threads[i], NULL) != 0) {
+            fprintf(stderr, "Error waiting for thread completion\n");
+            exit(1);
+        }
+    }
+    if (snap && pthread_join(snapshot_thread, NULL) != 0) {
+        fprintf(stderr, "Error waiting for thread completion\n");
+        exit(1);
+    }
+    free(threads);
+
+    /* compute the exact duration of the experiment */
+    return (end.tv_sec * 1000 + end.tv_usec / 1000) -
+           (start->tv_sec * 1000 + start->tv_usec / 1000);
+}
+
+/* Run one experiment per entry of sweep_threads, all on the same values: the
+ * list is filled once and saved aside, unless it was loaded from load_path,
+ * and loaded back before each experiment. With --refill, the threads of each
+ * experiment add a random share of the values to an empty list instead, as in
+ * a run of its own, which takes as long as filling it. Prints the table of
+ * scripts/scalability1.sh.
+ */
+static void sweep(thread_data_t *data, const int *sweep_threads, int n_sweep,
+                  int duration, const char *load_path)
+{
+    struct timeval start;
+
+    /* the layout of the fill is lost on loading, a single thread does it */
+    char image[] = "/tmp/concurrent-ll.XXXXXX";
+    if (!load_path) {
+        init_data(data, 1, max_key / 2, NULL);
+        run(data, 1, -1, NULL, &start);
+        int fd = mkstemp(image);
+        if (fd < 0 || !list_save(the_list, image)) {
+            fprintf(stderr, "Error saving the list aside\n");
+            exit(1);
+        }
+        close(fd);
+        load_path = image;
+    }
+
+    /* with --refill, record the values, in random order */
+    long initial = list_size(the_list);
+    val_t *vals = NULL;
+    if (sweep_refill) {
+        vals = malloc((initial ? initial : 1) * sizeof(val_t));
+        if (!vals) {
+            perror("malloc");
+            exit(1);
+        }
+        list_iter_t *it = list_iter_new(the_list);
+        for (long i = 0; i < initial && list_iter_next(it, &vals[i]); i++)
+            ;
+        list_iter_delete(it);
+        uint64_t *s = seed_rand();
+        for (long i = initial - 1; i > 0; i--) {
+            long j = my_random(&s[0], &s[1], &s[2]) % (i + 1);
+            val_t v = vals[i];
+            vals[i] = vals[j];
+            vals[j] = v;
+        }
+        free(s);
+    }
+
+    long thr1 = 0;
+    printf("#cores  throughput  %%linear scalability\n");
+    for (int k = 0; k < n_sweep; k++) {
+        int n_threads = sweep_threads[k];
+        list_delete(the_list);
+        if (vals) {
+            the_list = list_new();
+            init_data(data, n_threads, initial, vals);
+        } else {
+            if ((the_list = list_load(load_path)) == NULL) {
+                fprintf(stderr, "Error loading %s\n", load_path);
+                exit(1);
+            }
+            init_data(data, n_threads, 0, NULL);
+        }
+        int elapsed = run(data, n_threads, duration, NULL, &start);
+
+        unsigned long operations = 0;
+        long reported_total = initial;
+        for (int i = 0; i < n_threads; i++) {
+            operations += data[i].n_ops;
+            reported_total = reported_total + data[i].n_insert -
+                             data[i].n_remove - data[i].n_pop;
+        }
+        long thr = operations * 1000.0 / elapsed;
+        if (k == 0)
+            thr1 = thr;
+        double scl = (double) thr / thr1;
+
+        printf("%-8d%-12ld%-8.2f%-8.2f\n", n_threads, thr,
+               100 * (1 - (n_threads - scl) / n_threads), scl);
+        printf("# Expected size: %ld Actual size: %d\n", reported_total,
+               list_size(the_list));
+    }
+    free(vals);
+    if (load_path == image)
+        unlink(image);
+}
+
+int main(int argc, char *const argv[])
+{
+    struct timeval init, start;
 
     thread_data_t *data;
-    sigset_t block_set;
+    snapshot_data_t snapshot_data;
 
     /* initially, set parameters to their default values */
     int n_threads = DEFAULT_NUM_THREADS;
@@ -160,6 +602,10 @@ int main(int argc, char *const argv[])
     uint32_t updates = DEFAULT_UPDATES;
     finds = DEFAULT_READS;
     int duration = DEFAULT_DURATION;
+    int snapshot_interval = DEFAULT_SNAPSHOT;
+    const char *load_path = NULL, *save_path = NULL;
+    long rate = 0;
+    int sweep_threads[64], n_sweep = 0;
 
     /* now read the parameters in case the user provided values for them.
      * we use getopt, the same skeleton may be used for other bechmarks,
@@ -173,12 +619,23 @@ int main(int argc, char *const argv[])
         {"initial", required_argument, NULL, 'i'},
         {"num-threads", required_argument, NULL, 'n'},
         {"updates", required_argument, NULL, 'u'},
+        {"snapshot", required_argument, NULL, 's'},
+        {"hot", required_argument, NULL, 'k'},
+        {"miss", required_argument, NULL, 'm'},
+        {"rate", required_argument, NULL, 'R'},
+        {"poisson", no_argument, NULL, OPT_POISSON},
+        {"pq", no_argument, NULL, 'q'},
+        {"spray", required_argument, NULL, OPT_SPRAY},
+        {"load", required_argument, NULL, OPT_LOAD},
+        {"save", required_argument, NULL, OPT_SAVE},
+        {"sweep", required_argument, NULL, OPT_SWEEP},
+        {"refill", no_argument, NULL, OPT_REFILL},
         {NULL, 0, NULL, 0}};
 
     /* actually get the parameters form the command-line */
     while (1) {
         int i = 0;
-        int c = getopt_long(argc, argv, "hd:n:l:u:i:r:", long_options, &i);
+        int c = getopt_long(argc, argv, "hd:n:l:u:i:r:s:k:m:qR:", long_options, &i);
         if (c == -1)
             break;
 
@@ -205,7 +662,29 @@ int main(int argc, char *const argv[])
                    "  -r, --range <int>\n"
                    "        Key range (default=" XSTR(DEFAULT_RANGE) ")\n"
                    "  -n, --num-threads <int>\n"
-                   "        Number of threads (default=" XSTR(DEFAULT_NUM_THREADS) ")\n",
+                   "        Number of threads (default=" XSTR(DEFAULT_NUM_THREADS) ")\n"
+                   "  -s, --snapshot <int>\n"
+                   "        Snapshot the list every <int> milliseconds during the test (0=never, default=" XSTR(DEFAULT_SNAPSHOT) ")\n"
+                   "  -k, --hot <int>\n"
+                   "        Updates only touch <int> values, spread over the key range (0=all, default=0)\n"
+                   "  -m, --miss <int>\n"
+                   "        Percentage of searches for values out of the key range, which miss (default=0)\n"
+                   "  -R, --rate <int>\n"
+                   "        Open loop: offered load in operations per second over all threads (0=closed loop, default=0)\n"
+                   "      --poisson\n"
+                   "        Open loop: Poisson arrivals instead of a fixed rate\n"
+                   "  -q, --pq\n"
+                   "        Priority queue mode: even threads add values, odd threads pop the smallest\n"
+                   "      --spray <int>\n"
+                   "        In priority queue mode, pop one of the <int> smallest values (default=1)\n"
+                   "      --load <file>\n"
+                   "        Start from the list saved in <file> instead of filling it\n"
+                   "      --save <file>\n"
+                   "        Save the list to <file> at the end of the test\n"
+                   "      --sweep <int>,<int>,...\n"
+                   "        Run a test per number of threads, each on the same values\n"
+                   "      --refill\n"
+                   "        With --sweep, have the threads of each test add the values again\n",
 		   argv[0]
             );
             exit(0);
@@ -226,6 +705,42 @@ int main(int argc, char *const argv[])
         case 'n':
             n_threads = atoi(optarg);
             break;
+        case 's':
+            snapshot_interval = atoi(optarg);
+            break;
+        case 'k':
+            hot_keys = atoi(optarg);
+            break;
+        case 'm':
+            misses = atoi(optarg);
+            break;
+        case 'R':
+            rate = atol(optarg);
+            break;
+        case OPT_POISSON:
+            poisson = true;
+            break;
+        case 'q':
+            pq_mode = true;
+            break;
+        case OPT_SPRAY:
+            spray_width = atoi(optarg);
+            break;
+        case OPT_LOAD:
+            load_path = optarg;
+            break;
+        case OPT_SAVE:
+            save_path = optarg;
+            break;
+        case OPT_SWEEP:
+            n_sweep = 0;
+            for (char *t = strtok(optarg, ","); t && n_sweep < 64;
+                 t = strtok(NULL, ","))
+                sweep_threads[n_sweep++] = atoi(t);
+            break;
+        case OPT_REFILL:
+            sweep_refill = true;
+            break;
         case '?':
             printf("Use -h or --help for help\n");
             exit(0);
@@ -234,56 +749,51 @@ int main(int argc, char *const argv[])
         }
     }
 
+    /* allocate for the largest experiment of the sweep */
+    for (int k = 0; k < n_sweep; k++)
+        if (k == 0 || sweep_threads[k] > n_threads)
+            n_threads = sweep_threads[k];
+
+    if (pq_mode && n_threads < 2) {
+        fprintf(stderr, "Priority queue mode needs at least 2 threads\n");
+        exit(1);
+    }
+
+    if (rate > 0)
+        arrival_interval = 1e9 * n_threads / rate;
+
     max_key--;
     /* we round the max key up to the nearest power of 2, which makes our random
      * key generation more efficient.
      */
     max_key = next_power_of_two(max_key) - 1;
 
-    /* initialization of the list */
-    the_list = list_new();
+    if (hot_keys > max_key)
+        hot_keys = max_key;
+    if (hot_keys > 0)
+        hot_stride = (max_key + 1) / hot_keys;
 
-    /* initialize the data which will be passed to the threads */
-    if ((data = malloc(n_threads * sizeof(thread_data_t))) == NULL) {
-        perror("malloc");
-        exit(1);
+    /* initialization of the list, either empty and filled by the threads or
+     * from a saved image.
+     */
+    long initial = 0;
+    gettimeofday(&init, NULL);
+    if (load_path) {
+        if ((the_list = list_load(load_path)) == NULL) {
+            fprintf(stderr, "Error loading %s\n", load_path);
+            exit(1);
+        }
+        initial = list_size(the_list);
+    } else {
+        the_list = list_new();
     }
 
-    if ((threads = malloc(n_threads * sizeof(pthread_t))) == NULL) {
-        perror("malloc");
+    /* initialize the data which will be passed to the threads */
+    if (posix_memalign((void **) &data, 64, n_threads * sizeof(thread_data_t))) {
+        perror("posix_memalign");
         exit(1);
     }
 
-    /* flag signaling the threads until when to run */
-    *running = 1;
-
-    /* global barrier init (used to start the threads at the same time) */
-    barrier_init(&barrier, n_threads + 1);
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
-    timeout.tv_sec = duration / 1000;
-    timeout.tv_nsec = (duration % 1000) * 1000000;
-
-    /* set the data for each thread and create the threads */
-    for (int i = 0; i < n_threads; i++) {
-        data[i].id = i;
-        data[i].n_ops = 0;
-        data[i].n_insert = 0;
-        data[i].n_remove = 0;
-        data[i].n_search = 0;
-        data[i].n_add = max_key / (2 * n_threads);
-        if (i < ((max_key / 2) % n_threads))
-            data[i].n_add++;
-        data[i].barrier = &barrier;
-        if (pthread_create(&threads[i], &attr, test, (void *) (&data[i])) !=
-            0) {
-            fprintf(stderr, "Error creating thread\n");
-            exit(1);
-        }
-    }
-    pthread_attr_destroy(&attr);
-
     /* Catch some signals */
     if (signal(SIGHUP, catcher) == SIG_ERR ||
         signal(SIGINT, catcher) == SIG_ERR ||
@@ -292,53 +802,102 @@ int main(int argc, char *const argv[])
         exit(1);
     }
 
-    /* Start threads */
-    barrier_cross(&barrier);
-    gettimeofday(&start, NULL);
-    if (duration > 0) {
-        /* sleep for the duration of the experiment */
-        nanosleep(&timeout, NULL);
-    } else {
-        sigemptyset(&block_set);
-        sigsuspend(&block_set);
+    if (n_sweep > 0) {
+        sweep(data, sweep_threads, n_sweep, duration, load_path);
+        free(data);
+        return 0;
     }
 
-    /* signal the threads to stop */
-    *running = 0;
-    gettimeofday(&end, NULL);
+    snapshot_data.interval = snapshot_interval;
+    init_data(data, n_threads, load_path ? 0 : max_key / 2, NULL);
+    duration = run(data, n_threads, duration,
+                   snapshot_interval > 0 ? &snapshot_data : NULL, &start);
 
-    /* Wait for thread completion */
-    for (int i = 0; i < n_threads; i++) {
-        if (pthread_join(threads[i], NULL) != 0) {
-            fprintf(stderr, "Error waiting for thread completion\n");
-            exit(1);
-        }
+    if (save_path && !list_save(the_list, save_path)) {
+        fprintf(stderr, "Error saving %s\n", save_path);
+        exit(1);
     }
 
-    /* compute the exact duration of the experiment */
-    duration = (end.tv_sec * 1000 + end.tv_usec / 1000) -
-               (start.tv_sec * 1000 + start.tv_usec / 1000);
-
-    unsigned long operations = 0;
-    long reported_total = 0;
+    /* the time it took to get the list ready for the experiment */
+    int startup = (start.tv_sec * 1000 + start.tv_usec / 1000) -
+                  (init.tv_sec * 1000 + init.tv_usec / 1000);
+
+    histogram_t latency;
+    hist_init(&latency);
+    unsigned long operations = 0, pops = 0, empty = 0;
+    unsigned long ranked = 0, rank_sum = 0;
+    unsigned long searches = 0, missed = 0, filtered = 0;
+    int rank_max = 0;
+    long reported_total = initial;
     /* report some experiment statistics */
     for (int i = 0; i < n_threads; i++) {
         printf("Thread %d\n", i);
         printf("  #operations   : %lu\n", data[i].n_ops);
         printf("  #inserts   : %lu\n", data[i].n_insert);
         printf("  #removes   : %lu\n", data[i].n_remove);
+        if (pq_mode)
+            printf("  #pops   : %lu\n", data[i].n_pop);
         operations += data[i].n_ops;
+        hist_merge(&latency, &data[i].latency);
+        pops += data[i].n_pop;
+        empty += data[i].n_empty;
+        ranked += data[i].n_ranked;
+        rank_sum += data[i].rank_sum;
+        searches += data[i].n_search;
+        missed += data[i].n_missed;
+        filtered += data[i].n_filtered;
+        if (data[i].rank_max > rank_max)
+            rank_max = data[i].rank_max;
         reported_total = reported_total + data[i].n_add + data[i].n_insert -
-                         data[i].n_remove;
+                         data[i].n_remove - data[i].n_pop;
     }
 
+    printf("Startup       : %d (ms)\n", startup);
     printf("Duration      : %d (ms)\n", duration);
     printf("#txs     : %lu (%f / s)\n", operations,
            operations * 1000.0 / duration);
-    printf("Expected size: %ld Actual size: %d\n", reported_total,
-           list_size(the_list));
+    if (arrival_interval > 0) {
+        printf("Offered load  : %ld ops/s (%s arrivals)\n", rate,
+               poisson ? "poisson" : "fixed");
+        printf("Latency (us)  : p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+               hist_percentile(&latency, 0.5) / 1000.0,
+               hist_percentile(&latency, 0.99) / 1000.0,
+               hist_percentile(&latency, 0.999) / 1000.0,
+               latency.max / 1000.0);
+    }
+    if (pq_mode) {
+        printf("#pops    : %lu (%f / s), %lu found the list empty\n", pops,
+               pops * 1000.0 / duration, empty);
+        printf("Rank error    : avg %.2f, max %d (1 pop in %d)\n",
+               ranked ? (double) rank_sum / ranked : 0.0, rank_max,
+               RANK_SAMPLE);
+    }
+#if defined(BLOOM)
+    printf("Filter        : answered %.1f%% of the searches, %.1f%% of the "
+           "misses\n",
+           searches ? 100.0 * filtered / searches : 0.0,
+           missed ? 100.0 * filtered / missed : 0.0);
+#endif
+    if (snapshot_interval > 0 && snapshot_data.n_snapshots > 0) {
+        printf("#snapshots    : %lu (avg size %.1f, avg latency %.1f us)\n",
+               snapshot_data.n_snapshots,
+               (double) snapshot_data.total_size / snapshot_data.n_snapshots,
+               (double) snapshot_data.total_latency /
+                   snapshot_data.n_snapshots);
+    }
+
+    int size = list_size(the_list);
+    list_mem_t mem;
+    list_mem(the_list, &mem);
+    printf("Memory        : %zu live nodes, %zu retired, %zu free, "
+           "%.1f bytes/key\n",
+           mem.live, mem.retired, mem.free,
+           size ? (double) mem.bytes / size : 0.0);
+    if (rss.end > 0)
+        printf("RSS (KiB)     : start %ld max %ld end %ld\n", rss.start,
+               rss.max, rss.end);
+    printf("Expected size: %ld Actual size: %d\n", reported_total, size);
 
-    free(threads);
     free(data);
 
     return 0;
@@ -0,0 +1,250 @@
+/* Single-thread microbenchmark of the list operations: measures the cost of
+ * uncontended operations, and the number of nodes they traverse, over a
+ * range of list sizes.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "list.h"
+#include "utils.h"
+
+#define XSTR(s) STR(s)
+#define STR(s) #s
+
+/* the list sizes go from MIN_SIZE to max_size, by factors of 4 */
+#define MIN_SIZE 16
+#define DEFAULT_MAX_SIZE (1 << 20)
+
+/* each measurement traverses about this many nodes */
+#define VISIT_BUDGET (1 << 24)
+
+/* keys per batch, at most */
+#define MAX_BATCH 1024
+
+typedef struct result {
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t ticks;
+    uint64_t visited;
+} result_t;
+
+enum { CONTAINS_HIT, CONTAINS_MISS, ADD_NEW, ADD_EXISTING, REMOVE_PRESENT,
+       REMOVE_ABSENT, N_OPS };
+
+static const char *op_names[N_OPS] = {
+    "contains-hit", "contains-miss", "add-new",
+    "add-existing", "remove-present", "remove-absent",
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* time of a now_ns()/getticks() pair, taken out of each batch */
+static uint64_t overhead_ns, overhead_ticks;
+
+static void calibrate(void)
+{
+    const int n = 1 << 16;
+    uint64_t start = now_ns();
+    ticks t = getticks();
+    for (int i = 0; i < n; i++) {
+        now_ns();
+        getticks();
+    }
+    overhead_ticks = (getticks() - t) / n;
+    overhead_ns = (now_ns() - start) / n;
+}
+
+/* The list of size n holds the even keys 2, 4, ..., 2n; an odd key is never
+ * in it. A batch of n_keys distinct keys is spread over the list by walking
+ * the n slots with an odd stride.
+ */
+static void make_keys(val_t *keys, int n_keys, uint32_t n, bool present)
+{
+    uint32_t slot = rand() % n;
+    for (int i = 0; i < n_keys; i++) {
+        keys[i] = 2 * (val_t) slot + (present ? 2 : 1);
+        slot = (slot + 0x9e3779b1U) & (n - 1);
+    }
+}
+
+static void run_batch(list_t *the_list, int op, const val_t *keys,
+                      int n_keys, result_t *r)
+{
+    unsigned long visited = list_visited;
+    uint64_t start = now_ns();
+    ticks t = getticks();
+    switch (op) {
+    case CONTAINS_HIT:
+    case CONTAINS_MISS:
+        for (int i = 0; i < n_keys; i++)
+            list_contains(the_list, keys[i]);
+        break;
+    case ADD_NEW:
+    case ADD_EXISTING:
+        for (int i = 0; i < n_keys; i++)
+            list_add(the_list, keys[i]);
+        break;
+    default:
+        for (int i = 0; i < n_keys; i++)
+            list_remove(the_list, keys[i]);
+        break;
+    }
+    uint64_t ticks_spent = getticks() - t;
+    uint64_t ns = now_ns() - start;
+
+    r->ops += n_keys;
+    r->ns += ns > overhead_ns ? ns - overhead_ns : 0;
+    r->ticks += ticks_spent > overhead_ticks ? ticks_spent - overhead_ticks : 0;
+    r->visited += list_visited - visited;
+}
+
+/* measure each operation on a list of size n loaded from image */
+static void measure(const char *image, uint32_t n)
+{
+    list_t *the_list = list_load(image);
+    if (!the_list) {
+        fprintf(stderr, "Error loading %s\n", image);
+        exit(1);
+    }
+
+    int n_keys = VISIT_BUDGET / n;
+    if (n_keys > MAX_BATCH)
+        n_keys = MAX_BATCH;
+    if (n_keys > n)
+        n_keys = n;
+    if (n_keys < MIN_SIZE)
+        n_keys = MIN_SIZE;
+    long rounds = VISIT_BUDGET / ((long) n_keys * n);
+    if (rounds < 1)
+        rounds = 1;
+
+    val_t present[MAX_BATCH], absent[MAX_BATCH];
+    result_t results[N_OPS] = {{0}};
+    for (long r = -1; r < rounds; r++) {
+        make_keys(present, n_keys, n, true);
+        make_keys(absent, n_keys, n, false);
+
+        /* the first round warms up the caches and is not accounted */
+        result_t warmup[N_OPS] = {{0}};
+        result_t *res = r < 0 ? warmup : results;
+
+        run_batch(the_list, CONTAINS_HIT, present, n_keys, &res[CONTAINS_HIT]);
+        run_batch(the_list, CONTAINS_MISS, absent, n_keys,
+                  &res[CONTAINS_MISS]);
+        run_batch(the_list, ADD_EXISTING, present, n_keys,
+                  &res[ADD_EXISTING]);
+        run_batch(the_list, REMOVE_ABSENT, absent, n_keys,
+                  &res[REMOVE_ABSENT]);
+        /* the absent keys get added then removed: the list size stays n */
+        run_batch(the_list, ADD_NEW, absent, n_keys, &res[ADD_NEW]);
+        run_batch(the_list, REMOVE_PRESENT, absent, n_keys,
+                  &res[REMOVE_PRESENT]);
+        /* the lock-free list only marks the nodes it removes, and unlinks
+         * them on the next search of their keys: search them now, untimed,
+         * lest the lookups of the next round walk them
+         */
+        result_t unlink = {0};
+        run_batch(the_list, REMOVE_ABSENT, absent, n_keys, &unlink);
+    }
+
+    for (int op = 0; op < N_OPS; op++) {
+        result_t *r = &results[op];
+        printf("%-10u%-16s%-12.1f%-12.1f%-12.1f\n", n, op_names[op],
+               (double) r->ns / r->ops, (double) r->ticks / r->ops,
+               (double) r->visited / r->ops);
+    }
+
+    if (list_size(the_list) != n) {
+        fprintf(stderr, "Error: size %d instead of %u\n",
+                list_size(the_list), n);
+        exit(1);
+    }
+    list_delete(the_list);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_size = DEFAULT_MAX_SIZE;
+
+    struct option long_options[] = {
+        /* These options don't set a flag */
+        {"help", no_argument, NULL, 'h'},
+        {"max-size", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0}};
+
+    while (1) {
+        int i = 0;
+        int c = getopt_long(argc, argv, "hm:", long_options, &i);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+            printf("single-thread list microbenchmark\n"
+                   "\n"
+                   "Usage:\n"
+                   "  %s [options...]\n"
+                   "\n"
+                   "Options:\n"
+                   "  -h, --help\n"
+                   "        Print this message\n"
+                   "  -m, --max-size <int>\n"
+                   "        Largest list size (default=" XSTR(
+                       DEFAULT_MAX_SIZE) ")\n",
+                   argv[0]);
+            exit(0);
+        case 'm':
+            max_size = next_power_of_two(atoi(optarg));
+            break;
+        case '?':
+        default:
+            printf("Use -h or --help for help\n");
+            exit(1);
+        }
+    }
+
+    srand(getticks());
+    calibrate();
+
+    /* the images of the lists are built directly, as filling a large list
+     * with list_add takes quadratic time
+     */
+    char image[] = "/tmp/concurrent-ll.XXXXXX";
+    int fd = mkstemp(image);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+    val_t *vals = malloc(max_size * sizeof(val_t));
+    if (!vals) {
+        perror("malloc");
+        exit(1);
+    }
+
+    printf("#%s\n", argv[0]);
+    printf("#size    op              ns/op       ticks/op    nodes/op\n");
+    for (uint32_t n = MIN_SIZE; n <= max_size; n *= 4) {
+        for (uint32_t i = 0; i < n; i++)
+            vals[i] = 2 * (val_t) i + 2;
+        if (!image_write(image, vals, n)) {
+            fprintf(stderr, "Error writing %s\n", image);
+            exit(1);
+        }
+        measure(image, n);
+    }
+
+    unlink(image);
+    free(vals);
+    return 0;
+}
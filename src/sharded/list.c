@@ -0,0 +1,622 @@
+/* Range-partitioned front-end: the key space is split into contiguous shards,
+ * each of them an independent list of the backend selected at build time.
+ * An immutable router maps values to shards; shards that grow too long are
+ * split in two, and neighbours that shrink too much are merged, by installing
+ * a new router.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+/* The backend is compiled into this unit under the shard_ prefix, so that the
+ * front-end can provide the list.h interface itself.
+ */
+#define val_t shard_val_t
+#define node shard_node
+#define node_t shard_node_t
+#define list shard_list
+#define list_t shard_list_t
+#define list_iter shard_list_iter
+#define list_iter_t shard_list_iter_t
+#define list_new shard_list_new
+#define list_contains shard_list_contains
+#define list_add shard_list_add
+#define list_remove shard_list_remove
+#define list_pop_min shard_list_pop_min
+#define list_pop_spray shard_list_pop_spray
+#define list_delete shard_list_delete
+#define list_size shard_list_size
+#define list_iter_new shard_list_iter_new
+#define list_iter_next shard_list_iter_next
+#define list_iter_delete shard_list_iter_delete
+#define list_save shard_list_save
+#define list_load shard_list_load
+#define list_build shard_list_build
+#define list_mem shard_list_mem
+#define list_mem_t shard_list_mem_t
+
+/* a shard is split once it holds more values than this, and merged with a
+ * neighbour once both together hold less than a quarter of it.
+ */
+#ifndef SHARD_SPLIT_SIZE
+#define SHARD_SPLIT_SIZE 512
+#endif
+
+/* A shard holds about SHARD_SPLIT_SIZE values at most, for which a smaller
+ * filter and a smaller arena are enough. The arena of a shard is not backed by
+ * huge pages, and the shard is rebuilt into a fresh one once half of it was
+ * handed out: the lock-free list only reclaims the nodes it unlinks epochs
+ * later, and not while snapshots are taken.
+ */
+#ifndef BLOOM_COUNTERS
+#define BLOOM_COUNTERS 4096
+#endif
+#ifndef SHARD_CAPACITY
+#define SHARD_CAPACITY (16 * SHARD_SPLIT_SIZE)
+#endif
+#undef ARENA_CAPACITY
+#define ARENA_CAPACITY SHARD_CAPACITY
+
+#if defined(LOCK_BASED)
+#include "../lock/list.c"
+#else
+#include "../lockfree/list.c"
+#endif
+
+#undef val_t
+#undef node
+#undef node_t
+#undef list
+#undef list_t
+#undef list_iter
+#undef list_iter_t
+#undef list_new
+#undef list_contains
+#undef list_add
+#undef list_remove
+#undef list_pop_min
+#undef list_pop_spray
+#undef list_delete
+#undef list_size
+#undef list_iter_new
+#undef list_iter_next
+#undef list_iter_delete
+#undef list_save
+#undef list_load
+#undef list_build
+#undef list_mem
+#undef list_mem_t
+
+#undef _LIST_H_
+#include "list.h"
+
+#define VAL_MIN INTPTR_MIN
+
+/* maximum number of threads using sharded lists at the same time */
+#ifndef SHARD_MAX_USERS
+#define SHARD_MAX_USERS 1024
+#endif
+
+typedef struct shard {
+    shard_list_t *list;
+    uint32_t frozen; /* set while operations must stay away from the shard */
+    int32_t size;    /* approximate number of values, to trigger resizes */
+} shard_t;
+
+/* Each thread announces the operations it runs in a slot of its own, so that
+ * they only write to their own cache line: its sequence number is odd during
+ * an operation, which also names the shard it uses once known. A resize scans
+ * the slots to wait for the users of a shard, or for all the operations that
+ * may still read a router or a shard it replaced, before freeing them.
+ */
+typedef struct user {
+    uint64_t seq ALIGNED(64); /* odd while the thread runs an operation */
+    shard_t *shard;           /* shard in use, NULL if not known yet */
+    uint32_t taken;           /* set while a thread owns the slot */
+} user_t;
+
+/* announced by an operation that waits for a frozen shard, using none */
+#define SHARD_WAITING ((shard_t *) 0x1L)
+
+static user_t users[SHARD_MAX_USERS];
+static uint32_t n_users; /* slots ever taken, to bound the scans */
+static __thread user_t *me;
+static pthread_key_t user_key;
+static pthread_once_t user_once = PTHREAD_ONCE_INIT;
+
+typedef struct route {
+    val_t lo; /* smallest value of the shard */
+    shard_t *shard;
+} route_t;
+
+typedef struct router {
+    int n_shards;
+    route_t routes[]; /* sorted by lo, the first one starts at VAL_MIN */
+} router_t;
+
+struct list {
+    router_t *router;
+    int n_shards;      /* number of shards of router */
+    uint32_t resizing; /* serializes the changes of router and freezes */
+};
+
+struct list_iter {
+    val_t *vals; /* values of the snapshot, in ascending order */
+    int size;
+    int pos;
+};
+
+/* return the index of the route of the shard owning val */
+static int route(router_t *r, val_t val)
+{
+    int lo = 0, hi = r->n_shards - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (r->routes[mid].lo <= val)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* the slot of a thread is given back when the thread exits */
+static void user_release(void *slot)
+{
+    user_t *u = slot;
+    __atomic_store_n(&u->taken, 0, __ATOMIC_RELEASE);
+}
+
+static void user_key_create(void)
+{
+    if (pthread_key_create(&user_key, user_release) != 0) {
+        perror("pthread_key_create");
+        exit(1);
+    }
+}
+
+static user_t *user_slot(void)
+{
+    if (me)
+        return me;
+    pthread_once(&user_once, user_key_create);
+    for (uint32_t i = 0; i < SHARD_MAX_USERS; i++) {
+        if (CAS_U32(&users[i].taken, 0, 1) == 0) {
+            uint32_t n = __atomic_load_n(&n_users, __ATOMIC_RELAXED);
+            while (n <= i && CAS_U32(&n_users, n, i + 1) != n)
+                n = __atomic_load_n(&n_users, __ATOMIC_RELAXED);
+            me = &users[i];
+            pthread_setspecific(user_key, me);
+            return me;
+        }
+    }
+    fprintf(stderr, "more than %d threads use sharded lists\n",
+            SHARD_MAX_USERS);
+    exit(1);
+}
+
+static void shard_leave(shard_t *shard)
+{
+    __atomic_store_n(&me->shard, NULL, __ATOMIC_RELAXED);
+    __atomic_store_n(&me->seq, me->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Register as a user of the shard owning val. A frozen shard is being
+ * replaced or read as a whole, so we wait for either to be over.
+ */
+static shard_t *shard_enter(list_t *the_list, val_t val)
+{
+    user_t *u = user_slot();
+    while (1) {
+        /* pairs with shard_freeze and users_sync: either they see the
+         * operation, or it sees their updates
+         */
+        __atomic_store_n(&u->seq, u->seq + 1, __ATOMIC_SEQ_CST);
+        router_t *r = __atomic_load_n(&the_list->router, __ATOMIC_SEQ_CST);
+        shard_t *shard = r->routes[route(r, val)].shard;
+        __atomic_store_n(&u->shard, shard, __ATOMIC_RELEASE);
+        if (!__atomic_load_n(&shard->frozen, __ATOMIC_SEQ_CST))
+            return shard;
+
+        __atomic_store_n(&u->shard, SHARD_WAITING, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&shard->frozen, __ATOMIC_SEQ_CST) &&
+               __atomic_load_n(&the_list->router, __ATOMIC_ACQUIRE) == r)
+            sched_yield();
+        shard_leave(shard);
+    }
+}
+
+/* keep new users away from the shard and wait for the current ones */
+static void shard_freeze(shard_t *shard)
+{
+    __atomic_store_n(&shard->frozen, 1, __ATOMIC_SEQ_CST);
+    uint32_t n = __atomic_load_n(&n_users, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t seq = __atomic_load_n(&users[i].seq, __ATOMIC_SEQ_CST);
+        if (!(seq & 1))
+            continue;
+        /* until the operation names another shard, it may use this one */
+        shard_t *s;
+        while (__atomic_load_n(&users[i].seq, __ATOMIC_SEQ_CST) == seq &&
+               ((s = __atomic_load_n(&users[i].shard, __ATOMIC_ACQUIRE)) ==
+                    NULL ||
+                s == shard))
+            sched_yield();
+    }
+}
+
+/* wait for the operations in progress to be over */
+static void users_sync(void)
+{
+    uint32_t n = __atomic_load_n(&n_users, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t seq = __atomic_load_n(&users[i].seq, __ATOMIC_SEQ_CST);
+        if (!(seq & 1))
+            continue;
+        while (__atomic_load_n(&users[i].seq, __ATOMIC_SEQ_CST) == seq)
+            sched_yield();
+    }
+}
+
+static void shard_thaw(shard_t *shard)
+{
+    __atomic_store_n(&shard->frozen, 0, __ATOMIC_SEQ_CST);
+}
+
+static void resize_lock(list_t *the_list)
+{
+    while (CAS_U32(&(the_list->resizing), 0, 1) == 1)
+        sched_yield();
+}
+
+static void resize_unlock(list_t *the_list)
+{
+    __atomic_store_n(&the_list->resizing, 0, __ATOMIC_RELEASE);
+}
+
+/* create a shard holding the size values in vals, which are sorted */
+static shard_t *new_shard(const val_t *vals, int size)
+{
+    shard_t *shard = malloc(sizeof(shard_t));
+    shard->list = shard_list_build(vals, size);
+    shard->frozen = 0;
+    shard->size = size;
+    return shard;
+}
+
+static router_t *new_router(int n_shards)
+{
+    router_t *r = malloc(sizeof(router_t) + n_shards * sizeof(route_t));
+    r->n_shards = n_shards;
+    return r;
+}
+
+/* Replace the shards [first, first + n_old) of the current router by the
+ * n_new given ones. The replaced shards must be frozen; they stay so, so that
+ * operations routed to them by the stale router retry, until the operations
+ * that may have read the stale router are over and they are all freed.
+ */
+static void replace_shards(list_t *the_list, int first, int n_old,
+                           route_t *new_routes, int n_new)
+{
+    router_t *old = the_list->router;
+    router_t *r = new_router(old->n_shards - n_old + n_new);
+    memcpy(r->routes, old->routes, first * sizeof(route_t));
+    memcpy(r->routes + first, new_routes, n_new * sizeof(route_t));
+    memcpy(r->routes + first + n_new, old->routes + first + n_old,
+           (old->n_shards - first - n_old) * sizeof(route_t));
+    __atomic_store_n(&the_list->router, r, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&the_list->n_shards, r->n_shards, __ATOMIC_RELAXED);
+
+    /* no operation can reach the lists of the old shards anymore */
+    for (int i = first; i < first + n_old; i++)
+        shard_list_delete(old->routes[i].shard->list);
+
+    users_sync();
+    for (int i = first; i < first + n_old; i++)
+        free(old->routes[i].shard);
+    free(old);
+}
+
+/* return the index of the route of shard, -1 if it was replaced */
+static int find_shard(router_t *r, shard_t *shard, val_t val)
+{
+    int i = route(r, val);
+    return r->routes[i].shard == shard ? i : -1;
+}
+
+/* return true if half of the arena of the shard was handed out */
+static bool shard_worn(shard_t *shard)
+{
+    return __atomic_load_n(&shard->list->arena.next, __ATOMIC_RELAXED) >
+           SHARD_CAPACITY / 2;
+}
+
+/* Replace a shard that grew too long by its two halves, and a worn one by a
+ * copy of it in a fresh arena.
+ */
+static void shard_rebuild(list_t *the_list, shard_t *shard, val_t val)
+{
+    resize_lock(the_list);
+    int i = find_shard(the_list->router, shard, val);
+    if (i < 0 || (shard->size <= SHARD_SPLIT_SIZE && !shard_worn(shard))) {
+        resize_unlock(the_list);
+        return;
+    }
+
+    shard_freeze(shard);
+    shard_list_iter_t *it = shard_list_iter_new(shard->list);
+    val_t lo = the_list->router->routes[i].lo;
+    if (it->size > SHARD_SPLIT_SIZE) {
+        int mid = it->size / 2;
+        route_t halves[2] = {
+            {lo, new_shard(it->vals, mid)},
+            {it->vals[mid], new_shard(it->vals + mid, it->size - mid)},
+        };
+        replace_shards(the_list, i, 1, halves, 2);
+    } else {
+        route_t copy = {lo, new_shard(it->vals, it->size)};
+        replace_shards(the_list, i, 1, &copy, 1);
+    }
+    shard_list_iter_delete(it);
+    resize_unlock(the_list);
+}
+
+static void shard_merge(list_t *the_list, shard_t *shard, val_t val)
+{
+    if (__atomic_load_n(&the_list->n_shards, __ATOMIC_RELAXED) < 2)
+        return;
+
+    resize_lock(the_list);
+    router_t *r = the_list->router;
+    int i = find_shard(r, shard, val);
+    if (i < 0 || r->n_shards < 2) {
+        resize_unlock(the_list);
+        return;
+    }
+
+    /* merge with the smaller neighbour */
+    if (i == r->n_shards - 1 ||
+        (i > 0 && r->routes[i - 1].shard->size < r->routes[i + 1].shard->size))
+        i--;
+    shard_t *left = r->routes[i].shard, *right = r->routes[i + 1].shard;
+    if (left->size + right->size >= SHARD_SPLIT_SIZE / 4) {
+        resize_unlock(the_list);
+        return;
+    }
+
+    shard_freeze(left);
+    shard_freeze(right);
+    shard_list_iter_t *it_left = shard_list_iter_new(left->list);
+    shard_list_iter_t *it_right = shard_list_iter_new(right->list);
+    int size = it_left->size + it_right->size;
+    val_t *vals = malloc((size ? size : 1) * sizeof(val_t));
+    memcpy(vals, it_left->vals, it_left->size * sizeof(val_t));
+    memcpy(vals + it_left->size, it_right->vals,
+           it_right->size * sizeof(val_t));
+    route_t merged = {r->routes[i].lo, new_shard(vals, size)};
+    replace_shards(the_list, i, 2, &merged, 1);
+
+    free(vals);
+    shard_list_iter_delete(it_left);
+    shard_list_iter_delete(it_right);
+    resize_unlock(the_list);
+}
+
+list_t *list_new()
+{
+    list_t *the_list = malloc(sizeof(list_t));
+    the_list->router = new_router(1);
+    the_list->router->routes[0].lo = VAL_MIN;
+    the_list->router->routes[0].shard = new_shard(NULL, 0);
+    the_list->n_shards = 1;
+    the_list->resizing = 0;
+    return the_list;
+}
+
+/* must not run concurrently with any other operation on the list */
+void list_delete(list_t *the_list)
+{
+    router_t *r = the_list->router;
+    for (int i = 0; i < r->n_shards; i++) {
+        shard_list_delete(r->routes[i].shard->list);
+        free(r->routes[i].shard);
+    }
+    free(r);
+    free(the_list);
+}
+
+bool list_contains(list_t *the_list, val_t val)
+{
+    shard_t *shard = shard_enter(the_list, val);
+    bool found = shard_list_contains(shard->list, val);
+    shard_leave(shard);
+    return found;
+}
+
+bool list_add(list_t *the_list, val_t val)
+{
+    shard_t *shard = shard_enter(the_list, val);
+    bool added = shard_list_add(shard->list, val);
+    int32_t size = 0;
+    if (added)
+        size = __atomic_add_fetch(&shard->size, 1, __ATOMIC_RELAXED);
+    /* the list of the shard may be gone once we leave it */
+    bool worn = shard_worn(shard);
+    shard_leave(shard);
+
+    if (size > SHARD_SPLIT_SIZE || worn)
+        shard_rebuild(the_list, shard, val);
+    return added;
+}
+
+bool list_remove(list_t *the_list, val_t val)
+{
+    shard_t *shard = shard_enter(the_list, val);
+    bool removed = shard_list_remove(shard->list, val);
+    int32_t size = SHARD_SPLIT_SIZE;
+    if (removed)
+        size = __atomic_sub_fetch(&shard->size, 1, __ATOMIC_RELAXED);
+    shard_leave(shard);
+
+    if (size < SHARD_SPLIT_SIZE / 8)
+        shard_merge(the_list, shard, val);
+    return removed;
+}
+
+/* Pop from the first shard that is not empty. Unlike the other operations,
+ * this is not linearizable across shards: a value may be added to a shard
+ * right after it was found empty.
+ */
+bool list_pop_spray(list_t *the_list, int width, val_t *val, int *skipped)
+{
+    val_t lo = VAL_MIN;
+    while (1) {
+        shard_t *shard = shard_enter(the_list, lo);
+        bool popped = shard_list_pop_spray(shard->list, width, val, skipped);
+        int32_t size = SHARD_SPLIT_SIZE;
+        if (popped)
+            size = __atomic_sub_fetch(&shard->size, 1, __ATOMIC_RELAXED);
+
+        /* find the next shard, if any, while the router cannot be freed */
+        router_t *r = __atomic_load_n(&the_list->router, __ATOMIC_ACQUIRE);
+        int i = route(r, lo) + 1;
+        bool last = i == r->n_shards;
+        val_t next = last ? lo : r->routes[i].lo;
+        shard_leave(shard);
+
+        if (size < SHARD_SPLIT_SIZE / 8)
+            shard_merge(the_list, shard, lo);
+        if (popped)
+            return true;
+        if (last)
+            return false;
+        lo = next;
+    }
+}
+
+bool list_pop_min(list_t *the_list, val_t *val)
+{
+    return list_pop_spray(the_list, 1, val, NULL);
+}
+
+/* Take a snapshot of every shard at once, shards being frozen meanwhile, and
+ * concatenate them into the newly allocated *vals.
+ * @return the number of values
+ */
+static int collect_shards(list_t *the_list, val_t **vals)
+{
+    resize_lock(the_list);
+    router_t *r = the_list->router;
+    for (int i = 0; i < r->n_shards; i++)
+        shard_freeze(r->routes[i].shard);
+
+    int size = 0, cap = 64;
+    *vals = malloc(cap * sizeof(val_t));
+    for (int i = 0; i < r->n_shards; i++) {
+        shard_list_iter_t *it = shard_list_iter_new(r->routes[i].shard->list);
+        if (size + it->size > cap) {
+            while (size + it->size > cap)
+                cap *= 2;
+            *vals = realloc(*vals, cap * sizeof(val_t));
+        }
+        memcpy(*vals + size, it->vals, it->size * sizeof(val_t));
+        size += it->size;
+        shard_list_iter_delete(it);
+    }
+
+    for (int i = 0; i < r->n_shards; i++)
+        shard_thaw(r->routes[i].shard);
+    resize_unlock(the_list);
+    return size;
+}
+
+int list_size(list_t *the_list)
+{
+    resize_lock(the_list);
+    router_t *r = the_list->router;
+    for (int i = 0; i < r->n_shards; i++)
+        shard_freeze(r->routes[i].shard);
+
+    int size = 0;
+    for (int i = 0; i < r->n_shards; i++)
+        size += shard_list_size(r->routes[i].shard->list);
+
+    for (int i = 0; i < r->n_shards; i++)
+        shard_thaw(r->routes[i].shard);
+    resize_unlock(the_list);
+    return size;
+}
+
+void list_mem(list_t *the_list, list_mem_t *mem)
+{
+    resize_lock(the_list);
+    router_t *r = the_list->router;
+    mem->live = mem->retired = mem->free = 0;
+    mem->bytes = sizeof(list_t) + sizeof(router_t) + r->n_shards * sizeof(route_t);
+    for (int i = 0; i < r->n_shards; i++) {
+        shard_list_mem_t shard_mem;
+        shard_list_mem(r->routes[i].shard->list, &shard_mem);
+        mem->live += shard_mem.live;
+        mem->retired += shard_mem.retired;
+        mem->free += shard_mem.free;
+        mem->bytes += sizeof(shard_t) + shard_mem.bytes;
+    }
+    resize_unlock(the_list);
+}
+
+list_iter_t *list_iter_new(list_t *the_list)
+{
+    list_iter_t *it = malloc(sizeof(list_iter_t));
+    it->size = collect_shards(the_list, &it->vals);
+    it->pos = 0;
+    return it;
+}
+
+bool list_iter_next(list_iter_t *it, val_t *val)
+{
+    if (it->pos == it->size)
+        return false;
+    *val = it->vals[it->pos++];
+    return true;
+}
+
+void list_iter_delete(list_iter_t *it)
+{
+    free(it->vals);
+    free(it);
+}
+
+bool list_save(list_t *the_list, const char *path)
+{
+    list_iter_t *it = list_iter_new(the_list);
+    bool ok = image_write(path, it->vals, it->size);
+    list_iter_delete(it);
+    return ok;
+}
+
+/* the image is cut into half-full shards */
+list_t *list_load(const char *path)
+{
+    uint64_t size;
+    size_t length;
+    /* the sizes of the lists are ints */
+    const val_t *vals = image_map(path, INT_MAX, &size, &length);
+    if (!vals)
+        return NULL;
+
+    int chunk = SHARD_SPLIT_SIZE / 2;
+    int n_shards = size ? (size + chunk - 1) / chunk : 1;
+    list_t *the_list = malloc(sizeof(list_t));
+    the_list->router = new_router(n_shards);
+    the_list->n_shards = n_shards;
+    the_list->resizing = 0;
+    for (int i = 0; i < n_shards; i++) {
+        uint64_t first = (uint64_t) i * chunk;
+        int n = size - first < chunk ? size - first : chunk;
+        the_list->router->routes[i].lo = i ? vals[first] : VAL_MIN;
+        the_list->router->routes[i].shard = new_shard(vals + first, n);
+    }
+
+    image_unmap(vals, length);
+    return the_list;
+}